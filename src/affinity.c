@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2026, agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <string.h>
+#include <errno.h>
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+#include "affinity.h"
+#include "logger.h"
+
+/*
+ * Each worker, whether a thread or a process, can be bound to a single CPU.
+ * Its event loop, connections and buffers then stay in the caches of that
+ * CPU, and since pages are allocated from the NUMA node of the CPU first
+ * touching them, the connection state of a worker is in memory local to the
+ * CPU processing it.
+ */
+
+#ifdef HAVE_SCHED_SETAFFINITY
+static cpu_set_t available_cpus;
+static int available_cpu_count = 0;
+#endif
+
+
+/*
+ * Returns the CPU the worker should be bound to, or -1 if workers are not
+ * bound. With cpu_affinity auto workers are assigned the CPUs sniproxy was
+ * started on in turn. Must first be called before any thread is bound.
+ */
+int
+worker_cpu(const struct Config *config, size_t worker) {
+    if (!config->cpu_affinity)
+        return -1;
+
+    if (config->cpu_count > 0)
+        return config->cpus[worker % config->cpu_count];
+
+#ifdef HAVE_SCHED_SETAFFINITY
+    if (available_cpu_count == 0) {
+        if (sched_getaffinity(0, sizeof(available_cpus), &available_cpus) < 0) {
+            warn("sched_getaffinity failed: %s", strerror(errno));
+            return -1;
+        }
+        available_cpu_count = CPU_COUNT(&available_cpus);
+    }
+
+    size_t n = worker % (size_t)available_cpu_count;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &available_cpus) && n-- == 0)
+            return cpu;
+#endif
+
+    return -1;
+}
+
+/*
+ * Bind the calling thread to the CPU
+ */
+void
+bind_cpu(int cpu) {
+    if (cpu < 0)
+        return;
+
+#ifdef HAVE_SCHED_SETAFFINITY
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+        warn("Failed to bind to CPU %d: %s", cpu, strerror(errno));
+    else
+        debug("bound to CPU %d", cpu);
+#endif
+}
@@ -25,18 +25,95 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <ctype.h> /* isalnum(), isdigit(), tolower() */
 #include <sys/queue.h>
 #include <pcre.h>
 #include <assert.h>
 #include "backend.h"
 #include "address.h"
+#include "suffix_trie.h"
+#include "name_hash.h"
 #include "logger.h"
 
+/* JIT stack size limits, the default 32K machine stack is used if the
+ * allocation fails */
+#define JIT_STACK_MIN_SIZE (32 * 1024)
+#define JIT_STACK_MAX_SIZE (512 * 1024)
+
+/* Maximum number of regular expressions combined into a single pattern */
+#define COMBINED_PATTERNS_MAX 256
+
+
+enum PatternType {
+    PATTERN_REGEX,      /* requires PCRE */
+    PATTERN_EXACT,      /* matches a literal hostname */
+    PATTERN_SUFFIX,     /* matches any hostname below a literal domain */
+};
+
+/*
+ * A run of consecutive regular expression backends, either a single backend
+ * matched with its own pattern, or several backends combined into one
+ * alternation where each branch records its index with (*MARK).
+ */
+struct BackendMatcher {
+    const size_t *positions;    /* backend positions in table order */
+    size_t positions_len;
+    pcre *combined_re;          /* NULL for a single backend */
+    pcre_extra *combined_extra;
+};
+
+/*
+ * Lookup index for a list of backends: backends with literal hostname
+ * patterns are stored in a hash table, literal domain suffixes in a suffix
+ * trie, and the remaining patterns are evaluated using PCRE in order until
+ * one matches ahead of the best literal match.
+ */
+struct BackendIndex {
+    struct Backend **backends;  /* all backends in table order */
+    size_t backends_len;
+    struct NameHash *exact;
+    struct SuffixTrie *trie;
+    size_t first_suffix;        /* position of first PATTERN_SUFFIX backend */
+    size_t *regex_positions;    /* positions of PATTERN_REGEX backends */
+    size_t regex_positions_len;
+    size_t *alpn_positions;     /* positions of backends restricted by ALPN */
+    size_t alpn_positions_len;
+    struct BackendMatcher *matchers;
+    size_t matchers_len;
+};
+
 
 static void free_backend(struct Backend *);
+static pcre_extra *study_pattern(pcre *, const char *, int);
+static int pattern_jit_compiled(const pcre *, const pcre_extra *);
+static void free_pattern_extra(pcre_extra *);
+#ifdef PCRE_STUDY_JIT_COMPILE
+static pcre_jit_stack *backend_jit_stack(void *);
+#endif
 static const char *backend_config_options(const struct Backend *);
+static inline int backend_matches(const struct Backend *, const char *, size_t);
+static int backend_accepts_alpn(const struct Backend *, const char *, size_t);
+static int valid_alpn_list(const char *);
+static enum PatternType classify_pattern(const char *, char *, size_t *);
+static int init_backend_matchers(struct BackendIndex *, int);
+static int add_backend_matchers(struct BackendIndex *, const size_t *, size_t, int);
+#ifdef PCRE_EXTRA_MARK
+static char *combine_backend_patterns(const struct BackendIndex *,
+        const size_t *, size_t);
+#endif
+static int combinable_pattern(const char *, int *);
+static size_t backend_matcher_lookup(const struct BackendIndex *,
+        const struct BackendMatcher *, const char *, size_t);
 
+/*
+ * Lookups are only made from event loops, so all JIT compiled patterns share
+ * one JIT stack per worker thread.
+ */
+#ifdef PCRE_STUDY_JIT_COMPILE
+static __thread pcre_jit_stack *jit_stack = NULL;
+#endif
 
 struct Backend *
 new_backend() {
@@ -80,6 +157,18 @@ accept_backend_arg(struct Backend *backend, const char *arg) {
     } else if (backend->use_proxy_header == 0 &&
         strcasecmp(arg, "proxy_protocol") == 0) {
         backend->use_proxy_header = 1;
+    } else if (backend->alpn == NULL &&
+            strncasecmp(arg, "alpn=", 5) == 0) {
+        if (!valid_alpn_list(arg + 5)) {
+            err("Invalid ALPN protocol list: %s", arg + 5);
+            return -1;
+        }
+
+        backend->alpn = strdup(arg + 5);
+        if (backend->alpn == NULL) {
+            err("strdup failed");
+            return -1;
+        }
     } else {
         err("Unexpected table backend argument: %s", arg);
         return -1;
@@ -94,19 +183,23 @@ add_backend(struct Backend_head *backends, struct Backend *backend) {
 }
 
 int
-init_backend(struct Backend *backend) {
+init_backend(struct Backend *backend, int jit) {
     if (backend->pattern_re == NULL) {
         const char *reerr;
         int reerroffset;
 
         backend->pattern_re =
-            pcre_compile(backend->pattern, 0, &reerr, &reerroffset, NULL);
+            pcre_compile(backend->pattern, PCRE_CASELESS, &reerr,
+                    &reerroffset, NULL);
         if (backend->pattern_re == NULL) {
             err("Regex compilation of \"%s\" failed: %s, offset %d",
                     backend->pattern, reerr, reerroffset);
             return 0;
         }
 
+        backend->pattern_extra =
+            study_pattern(backend->pattern_re, backend->pattern, jit);
+
         char address[ADDRESS_BUFFER_SIZE];
         debug("Parsed %s %s",
                 backend->pattern,
@@ -117,8 +210,13 @@ init_backend(struct Backend *backend) {
     return 1;
 }
 
+/*
+ * Find the first backend matching name, which also accepts a client offering
+ * the ALPN protocols in alpn
+ */
 struct Backend *
-lookup_backend(const struct Backend_head *head, const char *name, size_t name_len) {
+lookup_backend(const struct Backend_head *head, const char *name, size_t name_len,
+        const char *alpn, size_t alpn_len) {
     struct Backend *iter;
 
     if (name == NULL) {
@@ -126,23 +224,656 @@ lookup_backend(const struct Backend_head *head, const char *name, size_t name_le
         name_len = 0;
     }
 
-    STAILQ_FOREACH(iter, head, entries) {
-        assert(iter->pattern_re != NULL);
-        if (pcre_exec(iter->pattern_re, NULL,
-                    name, name_len, 0, 0, NULL, 0) >= 0)
+    STAILQ_FOREACH(iter, head, entries)
+        if (backend_accepts_alpn(iter, alpn, alpn_len) &&
+                backend_matches(iter, name, name_len))
             return iter;
-    }
 
     return NULL;
 }
 
+/*
+ * Build a lookup index for the backends in head, which must remain unchanged
+ * for the lifetime of the index. If jit is set combined patterns are JIT
+ * compiled.
+ */
+struct BackendIndex *
+new_backend_index(const struct Backend_head *head, int jit) {
+    struct BackendIndex *index = calloc(1, sizeof(struct BackendIndex));
+    struct NameHashEntry *exact_entries = NULL;
+    size_t exact_entries_len = 0;
+    struct SuffixTrieEntry *suffix_entries = NULL;
+    size_t suffix_entries_len = 0;
+    char *literals = NULL;
+    size_t literals_size = 0;
+    struct Backend *iter;
+
+    if (index == NULL) {
+        err("%s: calloc", __func__);
+        return NULL;
+    }
+
+    STAILQ_FOREACH(iter, head, entries) {
+        index->backends_len++;
+        literals_size += strlen(iter->pattern);
+    }
+
+    index->first_suffix = SUFFIX_TRIE_NONE;
+    index->backends = malloc(index->backends_len * sizeof(struct Backend *) + 1);
+    index->regex_positions = malloc(index->backends_len * sizeof(size_t) + 1);
+    index->alpn_positions = malloc(index->backends_len * sizeof(size_t) + 1);
+    exact_entries = malloc(index->backends_len * sizeof(struct NameHashEntry) + 1);
+    suffix_entries = malloc(index->backends_len * sizeof(struct SuffixTrieEntry) + 1);
+    literals = malloc(literals_size + 1);
+    if (index->backends == NULL || index->regex_positions == NULL ||
+            index->alpn_positions == NULL || exact_entries == NULL || suffix_entries == NULL ||
+            literals == NULL) {
+        err("%s: malloc", __func__);
+        free(exact_entries);
+        free(suffix_entries);
+        free(literals);
+        free_backend_index(index);
+        return NULL;
+    }
+
+    size_t position = 0;
+    char *literal = literals;
+    STAILQ_FOREACH(iter, head, entries) {
+        size_t literal_len = 0;
+
+        index->backends[position] = iter;
+
+        /* Checked in order ahead of the best match for the hostname */
+        if (iter->alpn != NULL) {
+            index->alpn_positions[index->alpn_positions_len++] = position++;
+            continue;
+        }
+
+        enum PatternType type =
+            classify_pattern(iter->pattern, literal, &literal_len);
+
+        switch (type) {
+            case PATTERN_REGEX:
+                index->regex_positions[index->regex_positions_len++] = position;
+                break;
+            case PATTERN_EXACT:
+                exact_entries[exact_entries_len++] = (struct NameHashEntry){
+                    .name = literal,
+                    .name_len = literal_len,
+                    .value = position,
+                };
+                literal += literal_len;
+                break;
+            case PATTERN_SUFFIX:
+                if (index->first_suffix == SUFFIX_TRIE_NONE)
+                    index->first_suffix = position;
+                suffix_entries[suffix_entries_len++] = (struct SuffixTrieEntry){
+                    .name = literal,
+                    .name_len = literal_len,
+                    .wildcard = 1,
+                    .value = position,
+                };
+                literal += literal_len;
+                break;
+        }
+
+        position++;
+    }
+
+    index->exact = new_name_hash(exact_entries, exact_entries_len);
+    index->trie = new_suffix_trie(suffix_entries, suffix_entries_len);
+
+    debug("Indexed %zu exact and %zu suffix of %zu backend patterns",
+            exact_entries_len, suffix_entries_len, index->backends_len);
+
+    free(exact_entries);
+    free(suffix_entries);
+    free(literals);
+
+    if (index->exact == NULL || index->trie == NULL ||
+            init_backend_matchers(index, jit) < 0) {
+        free_backend_index(index);
+        return NULL;
+    }
+
+    return index;
+}
+
+/*
+ * Find the first backend in table order matching name and alpn, equivalent to
+ * lookup_backend() on the list the index was built from. Indexed literals are
+ * lowercase, so name must be too, as copy_hostname() leaves it.
+ */
+struct Backend *
+lookup_backend_index(const struct BackendIndex *index, const char *name,
+        size_t name_len, const char *alpn, size_t alpn_len) {
+    if (name == NULL) {
+        name = "";
+        name_len = 0;
+    }
+
+    /* PCRE's '$' and '.' treat newlines specially, let it handle these
+     * unusual names */
+    if (memchr(name, '\n', name_len) != NULL ||
+            memchr(name, '\0', name_len) != NULL) {
+        for (size_t i = 0; i < index->backends_len; i++)
+            if (backend_accepts_alpn(index->backends[i], alpn, alpn_len) &&
+                    backend_matches(index->backends[i], name, name_len))
+                return index->backends[i];
+
+        return NULL;
+    }
+
+    size_t match = name_hash_lookup(index->exact, name, name_len);
+
+    /* Only walk the trie if a suffix entry could precede the exact match */
+    if (index->first_suffix < match) {
+        size_t suffix_match = suffix_trie_lookup(index->trie, name, name_len);
+        if (suffix_match < match)
+            match = suffix_match;
+    }
+
+    /* Regular expressions preceding the literal match take precedence */
+    for (size_t i = 0; i < index->matchers_len &&
+            index->matchers[i].positions[0] < match; i++) {
+        size_t position = backend_matcher_lookup(index,
+                &index->matchers[i], name, name_len);
+
+        if (position < match) {
+            match = position;
+            break;
+        }
+    }
+
+    /* As do backends restricted to protocols the client offered */
+    for (size_t i = 0; alpn_len > 0 && i < index->alpn_positions_len &&
+            index->alpn_positions[i] < match; i++) {
+        const struct Backend *backend =
+            index->backends[index->alpn_positions[i]];
+
+        if (backend_accepts_alpn(backend, alpn, alpn_len) &&
+                backend_matches(backend, name, name_len)) {
+            match = index->alpn_positions[i];
+            break;
+        }
+    }
+
+    if (match >= index->backends_len)
+        return NULL;
+
+    return index->backends[match];
+}
+
+void
+free_backend_index(struct BackendIndex *index) {
+    if (index == NULL)
+        return;
+
+    for (size_t i = 0; i < index->matchers_len; i++) {
+        free_pattern_extra(index->matchers[i].combined_extra);
+        if (index->matchers[i].combined_re != NULL)
+            pcre_free(index->matchers[i].combined_re);
+    }
+    free(index->matchers);
+    free_name_hash(index->exact);
+    free_suffix_trie(index->trie);
+    free(index->regex_positions);
+    free(index->alpn_positions);
+    free(index->backends);
+    free(index);
+}
+
+static inline int
+backend_matches(const struct Backend *backend, const char *name, size_t name_len) {
+    assert(backend->pattern_re != NULL);
+
+    return pcre_exec(backend->pattern_re, backend->pattern_extra,
+                name, name_len, 0, 0, NULL, 0) >= 0;
+}
+
+/*
+ * Returns 1 if the backend is not restricted by ALPN or alpn, a list of
+ * length prefixed protocol names offered by the client, includes one of the
+ * backend's protocols
+ */
+static int
+backend_accepts_alpn(const struct Backend *backend, const char *alpn,
+        size_t alpn_len) {
+    if (backend->alpn == NULL)
+        return 1;
+
+    for (const char *protocol = backend->alpn; *protocol != '\0';) {
+        size_t protocol_len = strcspn(protocol, ",");
+
+        for (size_t pos = 0; pos < alpn_len; pos += 1 + (unsigned char)alpn[pos]) {
+            size_t len = (unsigned char)alpn[pos];
+
+            if (len == protocol_len && pos + 1 + len <= alpn_len &&
+                    memcmp(alpn + pos + 1, protocol, len) == 0)
+                return 1;
+        }
+
+        protocol += protocol_len;
+        if (*protocol == ',')
+            protocol++;
+    }
+
+    return 0;
+}
+
+static int
+valid_alpn_list(const char *list) {
+    size_t len = 0;
+
+    for (const char *c = list; ; c++) {
+        if (*c == ',' || *c == '\0') {
+            if (len == 0 || len > 255)
+                return 0;
+            if (*c == '\0')
+                return 1;
+            len = 0;
+        } else {
+            len++;
+        }
+    }
+}
+
+/*
+ * Study a compiled pattern, and JIT compile it if jit is set and PCRE
+ * supports it. Failures are not fatal, the pattern is then matched by the
+ * interpreter. Description is only used in log messages.
+ */
+static pcre_extra *
+study_pattern(pcre *re, const char *description, int jit) {
+    const char *reerr = NULL;
+    int options = 0;
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (jit)
+        options |= PCRE_STUDY_JIT_COMPILE;
+#else
+    (void)jit;
+#endif
+
+    pcre_extra *extra = pcre_study(re, options, &reerr);
+    if (reerr != NULL) {
+        warn("Regex study of %s failed: %s", description, reerr);
+        return NULL;
+    }
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (pattern_jit_compiled(re, extra))
+        pcre_assign_jit_stack(extra, backend_jit_stack, NULL);
+    else if (jit)
+        debug("Regex %s not JIT compiled", description);
+#endif
+
+    return extra;
+}
+
+static int
+pattern_jit_compiled(const pcre *re, const pcre_extra *extra) {
+    int jit_compiled = 0;
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (extra != NULL &&
+            pcre_fullinfo(re, extra, PCRE_INFO_JIT, &jit_compiled) != 0)
+        jit_compiled = 0;
+#else
+    (void)re;
+    (void)extra;
+#endif
+
+    return jit_compiled;
+}
+
+static void
+free_pattern_extra(pcre_extra *extra) {
+    if (extra == NULL)
+        return;
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+    pcre_free_study(extra);
+#else
+    pcre_free(extra);
+#endif
+}
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+static pcre_jit_stack *
+backend_jit_stack(void *data __attribute__((unused))) {
+    if (jit_stack == NULL)
+        jit_stack = pcre_jit_stack_alloc(JIT_STACK_MIN_SIZE, JIT_STACK_MAX_SIZE);
+
+    return jit_stack;
+}
+#endif
+
+void
+free_backend_jit_stack() {
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (jit_stack != NULL)
+        pcre_jit_stack_free(jit_stack);
+    jit_stack = NULL;
+#endif
+}
+
+/*
+ * Determine if a pattern matches exactly the same hostnames as a literal
+ * comparison, i.e.:
+ *      ^example\.com$         PATTERN_EXACT   example.com
+ *      ^.*\.example\.com$     PATTERN_SUFFIX  example.com
+ *      \.example\.com$        PATTERN_SUFFIX  example.com
+ *      ^.*$                   PATTERN_SUFFIX  (empty, matches everything)
+ *
+ * The unescaped hostname, which is not NUL terminated, is written to literal
+ * which must be at least as large as pattern.
+ *
+ * Only hostname characters are considered literal. Hostnames are looked up
+ * in lowercase and patterns are compiled caseless, so the literal is
+ * lowercased.
+ */
+static enum PatternType
+classify_pattern(const char *pattern, char *literal, size_t *literal_len) {
+    const char *p = pattern;
+    enum PatternType type = PATTERN_EXACT;
+    int anchored = 0;
+    size_t len = 0;
+
+    if (*p == '^') {
+        anchored = 1;
+        p++;
+    }
+
+    if (p[0] == '.' && p[1] == '*') {
+        p += 2;
+
+        if (p[0] == '\0' || (p[0] == '$' && p[1] == '\0')) {
+            /* matches every name */
+            *literal_len = 0;
+            return PATTERN_SUFFIX;
+        }
+
+        anchored = 1;
+        if (p[0] != '\\' || p[1] != '.')
+            return PATTERN_REGEX;
+        p += 2;
+        type = PATTERN_SUFFIX;
+    } else if (!anchored && p[0] == '\\' && p[1] == '.') {
+        p += 2;
+        anchored = 1;
+        type = PATTERN_SUFFIX;
+    }
+
+    if (!anchored)
+        return PATTERN_REGEX;
+
+    while (*p != '\0' && *p != '$') {
+        if (isalnum((unsigned char)*p) || *p == '-' || *p == '_') {
+            literal[len++] = tolower((unsigned char)*p++);
+        } else if (p[0] == '\\' && (p[1] == '.' || p[1] == '-')) {
+            literal[len++] = p[1];
+            p += 2;
+        } else {
+            return PATTERN_REGEX;
+        }
+    }
+
+    /* must be anchored at the end of the name */
+    if (p[0] != '$' || p[1] != '\0' || len == 0)
+        return PATTERN_REGEX;
+
+    *literal_len = len;
+
+    return type;
+}
+
+/*
+ * Group the regular expression backends of index into matchers, combining
+ * runs of consecutive combinable patterns
+ */
+static int
+init_backend_matchers(struct BackendIndex *index, int jit) {
+    size_t run_start = 0;
+
+    index->matchers = malloc(index->regex_positions_len *
+            sizeof(struct BackendMatcher) + 1);
+    if (index->matchers == NULL) {
+        err("%s: malloc", __func__);
+        return -1;
+    }
+
+    for (size_t i = 0; i < index->regex_positions_len; i++) {
+        const struct Backend *backend =
+            index->backends[index->regex_positions[i]];
+        int anchored;
+
+        if (combinable_pattern(backend->pattern, &anchored)) {
+            if (i + 1 - run_start < COMBINED_PATTERNS_MAX)
+                continue;
+
+            /* run is full */
+            if (add_backend_matchers(index, index->regex_positions + run_start,
+                        i + 1 - run_start, jit) < 0)
+                return -1;
+        } else {
+            if (add_backend_matchers(index, index->regex_positions + run_start,
+                        i - run_start, jit) < 0 ||
+                    add_backend_matchers(index, index->regex_positions + i,
+                        1, jit) < 0)
+                return -1;
+        }
+
+        run_start = i + 1;
+    }
+
+    if (add_backend_matchers(index, index->regex_positions + run_start,
+                index->regex_positions_len - run_start, jit) < 0)
+        return -1;
+
+    debug("Combined %zu regular expression backend patterns into %zu matchers",
+            index->regex_positions_len, index->matchers_len);
+
+    return 0;
+}
+
+/*
+ * Add matchers for a run of combinable backends. The patterns are only
+ * combined if the result is JIT compiled, the PCRE interpreter evaluates a
+ * large alternation slower than the individual patterns. If the combined
+ * pattern fails to compile (e.g. it exceeds the PCRE pattern size limit) the
+ * run is split in half.
+ */
+static int
+add_backend_matchers(struct BackendIndex *index, const size_t *positions,
+        size_t positions_len, int jit) {
+#ifdef PCRE_EXTRA_MARK
+    if (positions_len > 1 && jit) {
+        struct BackendMatcher *matcher = &index->matchers[index->matchers_len];
+        const char *reerr;
+        int reerroffset;
+
+        char *combined = combine_backend_patterns(index, positions, positions_len);
+        if (combined == NULL)
+            return -1;
+
+        pcre *re = pcre_compile(combined, PCRE_ANCHORED | PCRE_CASELESS,
+                &reerr, &reerroffset, NULL);
+        free(combined);
+
+        if (re == NULL) {
+            debug("Unable to combine %zu patterns: %s", positions_len, reerr);
+
+            size_t half = positions_len / 2;
+            if (add_backend_matchers(index, positions, half, jit) < 0)
+                return -1;
+
+            return add_backend_matchers(index, positions + half,
+                    positions_len - half, jit);
+        }
+
+        pcre_extra *extra = study_pattern(re, "combined table patterns", jit);
+        if (pattern_jit_compiled(re, extra)) {
+            *matcher = (struct BackendMatcher){
+                .positions = positions,
+                .positions_len = positions_len,
+                .combined_re = re,
+                .combined_extra = extra,
+            };
+            index->matchers_len++;
+
+            return 0;
+        }
+
+        free_pattern_extra(extra);
+        pcre_free(re);
+    }
+#else
+    (void)jit;
+#endif
+
+    /* Match each backend individually */
+    for (size_t i = 0; i < positions_len; i++)
+        index->matchers[index->matchers_len++] = (struct BackendMatcher){
+            .positions = positions + i,
+            .positions_len = 1,
+        };
+
+    return 0;
+}
+
+#ifdef PCRE_EXTRA_MARK
+/*
+ * Build a single pattern from a run of combinable backend patterns, branch i
+ * is (?:pattern)(*MARK:i). Patterns not anchored at the start of the name are
+ * prefixed with a lazy match of any characters so the alternation can be
+ * anchored and the first branch in table order which matches is the one
+ * reported.
+ */
+static char *
+combine_backend_patterns(const struct BackendIndex *index,
+        const size_t *positions, size_t positions_len) {
+    size_t combined_size = sizeof("(?:)");
+    for (size_t i = 0; i < positions_len; i++)
+        combined_size += strlen(index->backends[positions[i]]->pattern) +
+            sizeof("|(?s:.*?)(?:)(*MARK:)") + 20;
+
+    char *combined = malloc(combined_size);
+    if (combined == NULL) {
+        err("%s: malloc", __func__);
+        return NULL;
+    }
+
+    size_t len = snprintf(combined, combined_size, "(?:");
+    for (size_t i = 0; i < positions_len; i++) {
+        const char *pattern = index->backends[positions[i]]->pattern;
+        int anchored;
+
+        combinable_pattern(pattern, &anchored);
+        len += snprintf(combined + len, combined_size - len,
+                "%s%s(?:%s)(*MARK:%zu)",
+                i > 0 ? "|" : "",
+                anchored ? "" : "(?s:.*?)",
+                pattern, i);
+    }
+    snprintf(combined + len, combined_size - len, ")");
+
+    return combined;
+}
+#endif
+
+/*
+ * Determine if a pattern can be embedded in a larger alternation without
+ * changing what it matches: back references, named or numbered group
+ * references, verbs and most (? constructs are excluded. Anchored is set if
+ * the pattern can only match at the start of the name.
+ */
+static int
+combinable_pattern(const char *pattern, int *anchored) {
+    int depth = 0;
+    int in_class = 0;
+    int alternation = 0;
+
+    for (const char *p = pattern; *p != '\0'; p++) {
+        if (*p == '\\') {
+            p++;
+            if (*p == '\0' || isdigit((unsigned char)*p) || strchr("gkQEG", *p))
+                return 0;
+        } else if (in_class) {
+            if (*p == ']')
+                in_class = 0;
+        } else if (*p == '[') {
+            in_class = 1;
+            /* a leading ] is a literal */
+            if (p[1] == '^')
+                p++;
+            if (p[1] == ']')
+                p++;
+        } else if (*p == '(') {
+            if (p[1] == '*')
+                return 0;
+            if (p[1] == '?' && p[2] != ':' && p[2] != '=' && p[2] != '!' &&
+                    !(p[2] == '<' && (p[3] == '=' || p[3] == '!')))
+                return 0;
+            depth++;
+        } else if (*p == ')') {
+            depth--;
+        } else if (*p == '|' && depth == 0) {
+            alternation = 1;
+        }
+    }
+
+    *anchored = pattern[0] == '^' && !alternation;
+
+    return 1;
+}
+
+/*
+ * Returns the position of the first backend of matcher matching name, or
+ * SIZE_MAX if none match
+ */
+static size_t
+backend_matcher_lookup(const struct BackendIndex *index,
+        const struct BackendMatcher *matcher, const char *name, size_t name_len) {
+#ifdef PCRE_EXTRA_MARK
+    if (matcher->combined_re != NULL) {
+        /* The study data is shared, supply our own mark pointer */
+        pcre_extra extra = {.flags = 0};
+        unsigned char *mark = NULL;
+
+        if (matcher->combined_extra != NULL)
+            extra = *matcher->combined_extra;
+        extra.flags |= PCRE_EXTRA_MARK;
+        extra.mark = &mark;
+
+        int result = pcre_exec(matcher->combined_re, &extra,
+                name, name_len, 0, 0, NULL, 0);
+        if (result >= 0 && mark != NULL)
+            return matcher->positions[strtoul((const char *)mark, NULL, 10)];
+        else if (result == PCRE_ERROR_NOMATCH)
+            return SIZE_MAX;
+
+        /* Match limit or other error, evaluate each pattern */
+    }
+#endif
+
+    for (size_t i = 0; i < matcher->positions_len; i++)
+        if (backend_matches(index->backends[matcher->positions[i]],
+                    name, name_len))
+            return matcher->positions[i];
+
+    return SIZE_MAX;
+}
+
 void
 print_backend_config(FILE *file, const struct Backend *backend) {
     char address[ADDRESS_BUFFER_SIZE];
 
-    fprintf(file, "\t%s %s%s\n",
+    fprintf(file, "\t%s %s%s%s%s\n",
             backend->pattern,
             display_address(backend->address, address, sizeof(address)),
+            backend->alpn != NULL ? " alpn=" : "",
+            backend->alpn != NULL ? backend->alpn : "",
             backend_config_options(backend));
 }
 
@@ -167,6 +898,8 @@ free_backend(struct Backend *backend) {
 
     free(backend->pattern);
     free(backend->address);
+    free(backend->alpn);
+    free_pattern_extra(backend->pattern_extra);
     if (backend->pattern_re != NULL)
         pcre_free(backend->pattern_re);
     free(backend);
@@ -33,19 +33,29 @@
 
 STAILQ_HEAD(Backend_head, Backend);
 
+struct BackendIndex;
+
 struct Backend {
     char *pattern;
     struct Address *address;
     int use_proxy_header;
+    char *alpn;     /* comma separated ALPN protocols, NULL for any client */
 
     /* Runtime fields */
     pcre *pattern_re;
+    pcre_extra *pattern_extra;
     STAILQ_ENTRY(Backend) entries;
 };
 
 void add_backend(struct Backend_head *, struct Backend *);
-int init_backend(struct Backend *);
-struct Backend *lookup_backend(const struct Backend_head *, const char *, size_t);
+int init_backend(struct Backend *, int);
+struct Backend *lookup_backend(const struct Backend_head *, const char *, size_t,
+        const char *, size_t);
+struct BackendIndex *new_backend_index(const struct Backend_head *, int);
+struct Backend *lookup_backend_index(const struct BackendIndex *, const char *,
+        size_t, const char *, size_t);
+void free_backend_index(struct BackendIndex *);
+void free_backend_jit_stack();
 void print_backend_config(FILE *, const struct Backend *);
 void remove_backend(struct Backend_head *, struct Backend *);
 struct Backend *new_backend();
@@ -132,8 +132,9 @@ void
 stop_binder() {
     close(binder_sock);
 
+    /* worker processes share the binder of the supervisor */
     int status;
-    if (waitpid(binder_pid, &status, 0) < 0)
+    if (waitpid(binder_pid, &status, 0) < 0 && errno != ECHILD)
         err("waitpid: %s", strerror(errno));
 }
 
@@ -29,31 +29,97 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/uio.h>
+#include <sys/ioctl.h>
 #include <time.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <assert.h>
+#ifdef HAVE_MEMFD_CREATE
+#include <sys/mman.h>
+#endif
 #include <ev.h>
 #include "buffer.h"
+#include "pool.h"
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define NOT_POWER_OF_2(x) (x == 0 || (x & (x - 1)))
 
-
-static const size_t BUFFER_MAX_SIZE = 1024 * 1024 * 1024;
+/*
+ * Buffer storage of sizes between BUFFER_POOL_MIN_SIZE and
+ * BUFFER_POOL_MAX_SIZE is kept in a pool per size, each holding up to
+ * BUFFER_POOL_BYTES of released storage
+ */
+#define BUFFER_POOL_MIN_SIZE 4096
+#define BUFFER_POOL_MAX_SIZE 65536
+#define BUFFER_POOL_BYTES (8 * 1024 * 1024)
+#define STORAGE_POOL(size) \
+    POOL_INITIALIZER("buffer " #size, size, BUFFER_POOL_BYTES / size)
+#define MIRRORED_STORAGE_POOL(size) \
+    POOL_INITIALIZER_ALLOC("mirrored " #size, size, BUFFER_POOL_BYTES / size, \
+            alloc_mirrored_storage, free_mirrored_storage)
 
 
+static struct Buffer *alloc_buffer(size_t, int, struct ev_loop *);
 static size_t setup_write_iov(const struct Buffer *, struct iovec *, size_t);
 static size_t setup_read_iov(const struct Buffer *, struct iovec *, size_t);
 static inline void advance_write_position(struct Buffer *, size_t);
 static inline void advance_read_position(struct Buffer *, size_t);
+static struct Pool *storage_pool(size_t, int);
+static char *alloc_storage(size_t, int *);
+static void free_storage(char *, size_t, int);
+static void *alloc_mirrored_storage(size_t);
+static void free_mirrored_storage(void *, size_t);
+#ifdef HAVE_SPLICE
+static ssize_t splice_recv(struct Buffer *, int);
+static ssize_t splice_send(struct Buffer *, int);
+static int socket_has_pending_data(int);
+#endif
+
+
+static const size_t BUFFER_MAX_SIZE = 1024 * 1024 * 1024;
+
+/* Buffers are only used by the thread which allocated them */
+static __thread struct Pool buffer_pool =
+    POOL_INITIALIZER("buffer", sizeof(struct Buffer),
+            BUFFER_POOL_BYTES / BUFFER_POOL_MIN_SIZE);
+static __thread struct Pool storage_pools[] = {
+    STORAGE_POOL(4096),
+    STORAGE_POOL(8192),
+    STORAGE_POOL(16384),
+    STORAGE_POOL(32768),
+    STORAGE_POOL(65536),
+};
+static __thread struct Pool mirrored_storage_pools[] = {
+    MIRRORED_STORAGE_POOL(4096),
+    MIRRORED_STORAGE_POOL(8192),
+    MIRRORED_STORAGE_POOL(16384),
+    MIRRORED_STORAGE_POOL(32768),
+    MIRRORED_STORAGE_POOL(65536),
+};
 
 
 struct Buffer *
 new_buffer(size_t size, struct ev_loop *loop) {
+    return alloc_buffer(size, 0, loop);
+}
+
+/*
+ * Create a buffer whose storage is mapped twice back to back, so the contents
+ * are always contiguous in memory: buffer_coalesce() never copies and each
+ * recv or send uses a single iovec. Falls back to regular storage if the
+ * mirrored mapping can not be created, check the mirrored field to tell.
+ */
+struct Buffer *
+new_mirrored_buffer(size_t size, struct ev_loop *loop) {
+    return alloc_buffer(size, 1, loop);
+}
+
+static struct Buffer *
+alloc_buffer(size_t size, int mirrored, struct ev_loop *loop) {
     if (NOT_POWER_OF_2(size))
         return NULL;
-    struct Buffer *buf = malloc(sizeof(struct Buffer));
+    struct Buffer *buf = pool_alloc(&buffer_pool);
     if (buf == NULL)
         return NULL;
 
@@ -62,19 +128,63 @@ new_buffer(size_t size, struct ev_loop *loop) {
     buf->head = 0;
     buf->tx_bytes = 0;
     buf->rx_bytes = 0;
+    buf->pipe[0] = -1;
+    buf->pipe[1] = -1;
+    buf->pipe_size = 0;
+    buf->pipe_len = 0;
+    buf->pipe_full = 0;
+    buf->read_only = 0;
+    buf->mirrored = mirrored;
     buf->last_recv = ev_now(loop);
     buf->last_send = ev_now(loop);
-    buf->buffer = malloc(size);
+    buf->buffer = alloc_storage(size, &buf->mirrored);
     if (buf->buffer == NULL) {
-        free(buf);
+        pool_free(&buffer_pool, buf);
         buf = NULL;
     }
 
     return buf;
 }
 
+/*
+ * Create a buffer holding len bytes of data without copying it, data must
+ * remain valid until the buffer is freed. Nothing can be added to the buffer,
+ * so many buffers may share one copy of constant data.
+ */
+struct Buffer *
+new_read_only_buffer(const void *data, size_t len, struct ev_loop *loop) {
+    size_t size = 1;
+    while (size < len)
+        size <<= 1;
+
+    struct Buffer *buf = pool_alloc(&buffer_pool);
+    if (buf == NULL)
+        return NULL;
+
+    buf->buffer = (char *)data; /* cast away const'ness, never written */
+    buf->size_mask = size - 1;
+    buf->len = len;
+    buf->head = 0;
+    buf->tx_bytes = 0;
+    buf->rx_bytes = 0;
+    buf->pipe[0] = -1;
+    buf->pipe[1] = -1;
+    buf->pipe_size = 0;
+    buf->pipe_len = 0;
+    buf->pipe_full = 0;
+    buf->read_only = 1;
+    buf->mirrored = 0;
+    buf->last_recv = ev_now(loop);
+    buf->last_send = ev_now(loop);
+
+    return buf;
+}
+
 ssize_t
 buffer_resize(struct Buffer *buf, size_t new_size) {
+    if (buf->read_only)
+        return -5;
+
     if (NOT_POWER_OF_2(new_size))
         return -4;
 
@@ -84,31 +194,146 @@ buffer_resize(struct Buffer *buf, size_t new_size) {
     if (new_size < buf->len)
         return -1; /* new_size too small to hold existing data */
 
-    char *new_buffer = malloc(new_size);
+    int mirrored = buf->mirrored;
+    char *new_buffer = alloc_storage(new_size, &mirrored);
     if (new_buffer == NULL)
         return -2;
 
     buffer_peek(buf, new_buffer, new_size);
 
-    free(buf->buffer);
+    free_storage(buf->buffer, buffer_size(buf), buf->mirrored);
     buf->buffer = new_buffer;
+    buf->mirrored = mirrored;
     buf->size_mask = new_size - 1;
     buf->head = 0;
 
     return (ssize_t)buf->len;
 }
 
+/*
+ * Double the size of buf unless that would exceed max_size, returns the
+ * resulting size or a negative buffer_resize() error
+ */
+ssize_t
+buffer_grow(struct Buffer *buf, size_t max_size) {
+    size_t size = buffer_size(buf);
+
+    if (size * 2 > max_size)
+        return (ssize_t)size;
+
+    ssize_t result = buffer_resize(buf, size * 2);
+    if (result < 0)
+        return result;
+
+    return (ssize_t)buffer_size(buf);
+}
+
+/*
+ * Shrink buf to the smallest power of two of at least min_size which holds
+ * its content, returns the resulting size or a negative buffer_resize() error
+ */
+ssize_t
+buffer_shrink(struct Buffer *buf, size_t min_size) {
+    size_t size = min_size > 0 ? min_size : 1;
+
+    while (size < buf->len)
+        size *= 2;
+
+    if (size < buffer_size(buf)) {
+        ssize_t result = buffer_resize(buf, size);
+        if (result < 0)
+            return result;
+    }
+
+    return (ssize_t)buffer_size(buf);
+}
+
 void
 free_buffer(struct Buffer *buf) {
     if (buf == NULL)
         return;
 
-    free(buf->buffer);
-    free(buf);
+    if (buffer_is_spliced(buf)) {
+        close(buf->pipe[0]);
+        close(buf->pipe[1]);
+    }
+
+    if (!buf->read_only)
+        free_storage(buf->buffer, buffer_size(buf), buf->mirrored);
+    pool_free(&buffer_pool, buf);
+}
+
+/*
+ * Release all pooled buffer memory back to the system allocator
+ */
+void
+free_buffer_pools() {
+    pool_trim(&buffer_pool);
+    for (size_t i = 0; i < sizeof(storage_pools) / sizeof(storage_pools[0]); i++) {
+        pool_trim(&storage_pools[i]);
+        pool_trim(&mirrored_storage_pools[i]);
+    }
+}
+
+void
+print_buffer_pool_stats(FILE *file) {
+    print_pool_stats(file, &buffer_pool);
+    for (size_t i = 0; i < sizeof(storage_pools) / sizeof(storage_pools[0]); i++)
+        print_pool_stats(file, &storage_pools[i]);
+    for (size_t i = 0; i < sizeof(mirrored_storage_pools) / sizeof(mirrored_storage_pools[0]); i++)
+        print_pool_stats(file, &mirrored_storage_pools[i]);
+}
+
+/*
+ * Switch an empty buffer to relay data through a pipe using splice(2), so
+ * the data is never copied into user space.
+ *
+ * Returns 1 on success, 0 if splicing is not supported or could not be set up,
+ * in which case the buffer continues to operate as before.
+ */
+int
+buffer_splice(struct Buffer *buf) {
+#ifdef HAVE_SPLICE
+    if (buffer_is_spliced(buf))
+        return 1;
+
+    if (buf->len != 0 || buf->read_only)
+        return 0; /* existing content must be flushed first */
+
+    if (pipe2(buf->pipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+        buf->pipe[0] = -1;
+        buf->pipe[1] = -1;
+        return 0;
+    }
+
+#ifdef F_GETPIPE_SZ
+    int pipe_size = fcntl(buf->pipe[0], F_GETPIPE_SZ);
+#else
+    int pipe_size = -1;
+#endif
+    buf->pipe_size = pipe_size > 0 ? (size_t)pipe_size : buffer_size(buf);
+    buf->pipe_len = 0;
+
+    return 1;
+#else
+    (void)buf;
+
+    return 0;
+#endif
 }
 
 ssize_t
 buffer_recv(struct Buffer *buffer, int sockfd, int flags, struct ev_loop *loop) {
+#ifdef HAVE_SPLICE
+    if (buffer_is_spliced(buffer)) {
+        ssize_t bytes = splice_recv(buffer, sockfd);
+
+        buffer->last_recv = ev_now(loop);
+
+        return bytes;
+    }
+#endif
+
     /* coalesce when reading into an empty buffer */
     if (buffer->len == 0)
         buffer->head = 0;
@@ -131,6 +356,17 @@ buffer_recv(struct Buffer *buffer, int sockfd, int flags, struct ev_loop *loop)
 
 ssize_t
 buffer_send(struct Buffer *buffer, int sockfd, int flags, struct ev_loop *loop) {
+#ifdef HAVE_SPLICE
+    /* Data pushed before the buffer was spliced is sent first */
+    if (buffer_is_spliced(buffer) && buffer->len == 0) {
+        ssize_t bytes = splice_send(buffer, sockfd);
+
+        buffer->last_send = ev_now(loop);
+
+        return bytes;
+    }
+#endif
+
     struct iovec iov[2];
     struct msghdr msg = {
         .msg_iov = iov,
@@ -191,7 +427,7 @@ size_t
 buffer_coalesce(struct Buffer *buffer, const void **dst) {
     size_t buffer_tail = (buffer->head + buffer->len) & buffer->size_mask;
 
-    if (buffer_tail <= buffer->head) {
+    if (buffer->mirrored || buffer_tail <= buffer->head) {
         /* buffer not wrapped */
         if (dst != NULL)
             *dst = &buffer->buffer[buffer->head];
@@ -251,6 +487,10 @@ buffer_push(struct Buffer *dst, const void *src, size_t len) {
     struct iovec iov[2];
     size_t bytes_appended = 0;
 
+    /* appending behind data already in the pipe would reorder it */
+    if (dst->pipe_len != 0 || dst->read_only)
+        return 0;
+
     /* coalesce when reading into an empty buffer */
     if (dst->len == 0)
         dst->head = 0;
@@ -290,14 +530,15 @@ setup_write_iov(const struct Buffer *buffer, struct iovec *iov, size_t len) {
 
     size_t start = (buffer->head + buffer->len) & buffer->size_mask;
 
-    if (start + write_len <= buffer_size(buffer)) {
+    /* a mirrored buffer continues into its second mapping */
+    if (buffer->mirrored || start + write_len <= buffer_size(buffer)) {
         iov[0].iov_base = buffer->buffer + start;
         iov[0].iov_len = write_len;
 
         /* assert iov are within bounds, non-zero length and non-overlapping */
         assert(iov[0].iov_len > 0);
         assert((char *)iov[0].iov_base >= buffer->buffer);
-        assert((char *)iov[0].iov_base + iov[0].iov_len <= buffer->buffer + buffer_size(buffer));
+        assert((char *)iov[0].iov_base + iov[0].iov_len <= buffer->buffer + buffer_size(buffer) * (buffer->mirrored ? 2 : 1));
 
         return 1;
     } else {
@@ -327,14 +568,14 @@ setup_read_iov(const struct Buffer *buffer, struct iovec *iov, size_t len) {
     if (len != 0)
         read_len = MIN(len, buffer->len);
 
-    if (buffer->head + read_len <= buffer_size(buffer)) {
+    if (buffer->mirrored || buffer->head + read_len <= buffer_size(buffer)) {
         iov[0].iov_base = buffer->buffer + buffer->head;
         iov[0].iov_len = read_len;
 
         /* assert iov are within bounds, non-zero length and non-overlapping */
         assert(iov[0].iov_len > 0);
         assert((char *)iov[0].iov_base >= buffer->buffer);
-        assert((char *)iov[0].iov_base + iov[0].iov_len <= buffer->buffer + buffer_size(buffer));
+        assert((char *)iov[0].iov_base + iov[0].iov_len <= buffer->buffer + buffer_size(buffer) * (buffer->mirrored ? 2 : 1));
 
         return 1;
     } else {
@@ -367,3 +608,154 @@ advance_read_position(struct Buffer *buffer, size_t offset) {
     buffer->len -= offset;
     buffer->tx_bytes += offset;
 }
+
+#ifdef HAVE_SPLICE
+static ssize_t
+splice_recv(struct Buffer *buffer, int sockfd) {
+    size_t room = buffer->pipe_size - buffer->pipe_len;
+    ssize_t bytes = splice(sockfd, NULL, buffer->pipe[1], NULL, room,
+            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    int saved_errno = errno;
+
+    /* A pipe holds a limited number of segments rather than bytes, so it
+     * may be full before pipe_size is reached. When the socket still has
+     * data waiting after a short or refused splice, report no room until
+     * some of the pipe is drained, so we don't spin on a readable socket. */
+    if (bytes > 0) {
+        buffer->pipe_len += (size_t)bytes;
+        buffer->rx_bytes += (size_t)bytes;
+
+        if ((size_t)bytes < room && socket_has_pending_data(sockfd))
+            buffer->pipe_full = 1;
+    } else if (bytes < 0 && saved_errno == EAGAIN && buffer->pipe_len > 0 &&
+            socket_has_pending_data(sockfd)) {
+        buffer->pipe_full = 1;
+    }
+
+    errno = saved_errno;
+    return bytes;
+}
+
+static int
+socket_has_pending_data(int sockfd) {
+    int pending = 0;
+
+    if (ioctl(sockfd, FIONREAD, &pending) < 0)
+        return 0;
+
+    return pending > 0;
+}
+
+static ssize_t
+splice_send(struct Buffer *buffer, int sockfd) {
+    ssize_t bytes = splice(buffer->pipe[0], NULL, sockfd, NULL,
+            buffer->pipe_len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+    if (bytes > 0) {
+        buffer->pipe_len -= (size_t)bytes;
+        buffer->tx_bytes += (size_t)bytes;
+        buffer->pipe_full = 0;
+    }
+
+    return bytes;
+}
+#endif
+
+static struct Pool *
+storage_pool(size_t size, int mirrored) {
+    size_t i = 0;
+
+    if (size < BUFFER_POOL_MIN_SIZE || size > BUFFER_POOL_MAX_SIZE)
+        return NULL;
+
+    while ((size_t)BUFFER_POOL_MIN_SIZE << i < size)
+        i++;
+
+    return mirrored ? &mirrored_storage_pools[i] : &storage_pools[i];
+}
+
+/*
+ * Allocate storage for a buffer, if mirrored storage is requested but not
+ * available *mirrored is cleared and regular storage is returned
+ */
+static char *
+alloc_storage(size_t size, int *mirrored) {
+    if (*mirrored) {
+        struct Pool *pool = storage_pool(size, 1);
+        char *storage = pool != NULL ?
+            pool_alloc(pool) : alloc_mirrored_storage(size);
+        if (storage != NULL)
+            return storage;
+
+        *mirrored = 0;
+    }
+
+    struct Pool *pool = storage_pool(size, 0);
+
+    return pool != NULL ? pool_alloc(pool) : malloc(size);
+}
+
+static void
+free_storage(char *storage, size_t size, int mirrored) {
+    struct Pool *pool = storage_pool(size, mirrored);
+
+    if (pool != NULL)
+        pool_free(pool, storage);
+    else if (mirrored)
+        free_mirrored_storage(storage, size);
+    else
+        free(storage);
+}
+
+/*
+ * Map the same memfd pages at two consecutive addresses, so data written past
+ * the end of the first mapping lands at the start of the buffer
+ */
+static void *
+alloc_mirrored_storage(size_t size) {
+#ifdef HAVE_MEMFD_CREATE
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0 || size % (size_t)page_size != 0)
+        return NULL;
+
+    int fd = memfd_create("sniproxy buffer", MFD_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    if (ftruncate(fd, (off_t)size) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    /* reserve the address range, then replace both halves */
+    char *storage = mmap(NULL, 2 * size, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (storage != MAP_FAILED &&
+            (mmap(storage, size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+             mmap(storage + size, size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+        munmap(storage, 2 * size);
+        storage = MAP_FAILED;
+    }
+
+    /* the mappings keep the pages referenced */
+    close(fd);
+
+    return storage != MAP_FAILED ? storage : NULL;
+#else
+    (void)size;
+
+    return NULL;
+#endif
+}
+
+static void
+free_mirrored_storage(void *storage, size_t size) {
+#ifdef HAVE_MEMFD_CREATE
+    munmap(storage, 2 * size);
+#else
+    (void)storage;
+    (void)size;
+#endif
+}
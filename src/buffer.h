@@ -40,27 +40,49 @@ struct Buffer {
     ev_tstamp last_send;
     size_t tx_bytes;
     size_t rx_bytes;
+    int pipe[2];            /* splice(2) pipe, or -1 when not spliced */
+    size_t pipe_size;       /* capacity of pipe */
+    size_t pipe_len;        /* bytes currently held in pipe */
+    int pipe_full;          /* pipe refused data before reaching pipe_size */
+    int read_only;          /* buffer refers to data it does not own */
+    int mirrored;           /* storage mapped twice, contents contiguous */
 };
 
 struct Buffer *new_buffer(size_t, struct ev_loop *);
+struct Buffer *new_mirrored_buffer(size_t, struct ev_loop *);
+struct Buffer *new_read_only_buffer(const void *, size_t, struct ev_loop *);
 void free_buffer(struct Buffer *);
+void free_buffer_pools();
+void print_buffer_pool_stats(FILE *);
 
 ssize_t buffer_recv(struct Buffer *, int, int, struct ev_loop *);
 ssize_t buffer_send(struct Buffer *, int, int, struct ev_loop *);
 ssize_t buffer_read(struct Buffer *, int);
 ssize_t buffer_write(struct Buffer *, int);
 ssize_t buffer_resize(struct Buffer *, size_t);
+ssize_t buffer_grow(struct Buffer *, size_t);
+ssize_t buffer_shrink(struct Buffer *, size_t);
 size_t buffer_peek(const struct Buffer *, void *, size_t);
 size_t buffer_coalesce(struct Buffer *, const void **);
 size_t buffer_pop(struct Buffer *, void *, size_t);
 size_t buffer_push(struct Buffer *, const void *, size_t);
+int buffer_splice(struct Buffer *);
+static inline int buffer_is_spliced(const struct Buffer *b) {
+    return b->pipe[0] >= 0;
+}
 static inline size_t buffer_size(const struct Buffer *b) {
     return b->size_mask + 1;
 }
 static inline size_t buffer_len(const struct Buffer *b) {
-    return b->len;
+    return b->len + b->pipe_len;
 }
 static inline size_t buffer_room(const struct Buffer *b) {
+    if (b->read_only)
+        return 0;
+
+    if (buffer_is_spliced(b))
+        return b->pipe_full ? 0 : b->pipe_size - b->pipe_len;
+
     return buffer_size(b) - b->len;
 }
 
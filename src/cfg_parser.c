@@ -25,6 +25,7 @@
  */
 #include <stdio.h>
 #include <string.h>
+#include <strings.h> /* strcasecmp() */
 #include "cfg_parser.h"
 #include "cfg_tokenizer.h"
 #include "logger.h"
@@ -108,6 +109,33 @@ parse_config(void *context, FILE *cfg, const struct Keyword *grammar) {
     }
 }
 
+int
+parse_boolean(const char *boolean) {
+    const char *boolean_true[] = {
+        "yes",
+        "true",
+        "on",
+    };
+
+    const char *boolean_false[] = {
+        "no",
+        "false",
+        "off",
+    };
+
+    for (size_t i = 0; i < sizeof(boolean_true) / sizeof(boolean_true[0]); i++)
+        if (strcasecmp(boolean, boolean_true[i]) == 0)
+            return 1;
+
+    for (size_t i = 0; i < sizeof(boolean_false) / sizeof(boolean_false[0]); i++)
+        if (strcasecmp(boolean, boolean_false[i]) == 0)
+            return 0;
+
+    err("Unable to parse '%s' as a boolean value", boolean);
+
+    return -1;
+}
+
 static const struct Keyword *
 find_keyword(const struct Keyword *grammar, const char *word) {
     for (; grammar->keyword; grammar++)
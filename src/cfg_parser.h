@@ -38,5 +38,6 @@ struct Keyword {
 
 
 int parse_config(void *, FILE *, const struct Keyword *);
+int parse_boolean(const char *);
 
 #endif
@@ -25,13 +25,20 @@
  */
 #include <stdio.h>
 #include <stdint.h>
+#include <limits.h>
 #include <string.h>
+#include <strings.h> /* strcasecmp() */
 #include <errno.h>
 #include <assert.h>
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
 #include "cfg_parser.h"
 #include "config.h"
+#include "affinity.h"
 #include "logger.h"
 #include "connection.h"
+#include "resolv_cache.h"
 
 
 struct LoggerBuilder {
@@ -43,6 +50,14 @@ struct LoggerBuilder {
 static int accept_username(struct Config *, const char *);
 static int accept_groupname(struct Config *, const char *);
 static int accept_pidfile(struct Config *, const char *);
+static int accept_pcre_jit(struct Config *, const char *);
+static int accept_workers(struct Config *, const char *);
+static int accept_worker_processes(struct Config *, const char *);
+static int accept_cpu_affinity(struct Config *, const char *);
+static int cpu_affinity_equal(const struct Config *, const struct Config *);
+static int accept_event_backend(struct Config *, const char *);
+static int accept_worker_count(const char *, const char *, size_t *);
+static void shard_listeners(struct Listener_head *, int);
 static int end_listener_stanza(struct Config *, struct Listener *);
 static int end_table_stanza(struct Config *, struct Table *);
 static int end_backend(struct Table *, struct Backend *);
@@ -57,6 +72,12 @@ static struct ResolverConfig *new_resolver_config();
 static int accept_resolver_nameserver(struct ResolverConfig *, const char *);
 static int accept_resolver_search(struct ResolverConfig *, const char *);
 static int accept_resolver_mode(struct ResolverConfig *, const char *);
+static int accept_resolver_cache_size(struct ResolverConfig *, const char *);
+static int accept_resolver_cache_min_ttl(struct ResolverConfig *, const char *);
+static int accept_resolver_cache_max_ttl(struct ResolverConfig *, const char *);
+static int accept_resolver_cache_negative_ttl(struct ResolverConfig *, const char *);
+static int accept_resolver_cache_stale_ttl(struct ResolverConfig *, const char *);
+static int parse_ttl(const char *, unsigned int *);
 static int end_resolver_stanza(struct Config *, struct ResolverConfig *);
 static inline size_t string_vector_len(char **);
 static int append_to_string_vector(char ***, const char *) __attribute__((nonnull(1)));
@@ -95,6 +116,26 @@ static const struct Keyword resolver_stanza_grammar[] = {
         .keyword="mode",
         .parse_arg=(int(*)(void *, const char *))accept_resolver_mode,
     },
+    {
+        .keyword="cache_size",
+        .parse_arg=(int(*)(void *, const char *))accept_resolver_cache_size,
+    },
+    {
+        .keyword="cache_min_ttl",
+        .parse_arg=(int(*)(void *, const char *))accept_resolver_cache_min_ttl,
+    },
+    {
+        .keyword="cache_max_ttl",
+        .parse_arg=(int(*)(void *, const char *))accept_resolver_cache_max_ttl,
+    },
+    {
+        .keyword="cache_negative_ttl",
+        .parse_arg=(int(*)(void *, const char *))accept_resolver_cache_negative_ttl,
+    },
+    {
+        .keyword="cache_stale_ttl",
+        .parse_arg=(int(*)(void *, const char *))accept_resolver_cache_stale_ttl,
+    },
     {
         .keyword = NULL,
     },
@@ -125,6 +166,30 @@ static const struct Keyword listener_stanza_grammar[] = {
         .keyword="source",
         .parse_arg=(int(*)(void *, const char *))accept_listener_source_address,
     },
+    {
+        .keyword="splice",
+        .parse_arg=(int(*)(void *, const char *))accept_listener_splice,
+    },
+    {
+        .keyword="mirrored_buffers",
+        .parse_arg=(int(*)(void *, const char *))accept_listener_mirrored_buffers,
+    },
+    {
+        .keyword="lookup_cache",
+        .parse_arg=(int(*)(void *, const char *))accept_listener_lookup_cache,
+    },
+    {
+        .keyword="max_buffer_size",
+        .parse_arg=(int(*)(void *, const char *))accept_listener_max_buffer_size,
+    },
+    {
+        .keyword="max_request_size",
+        .parse_arg=(int(*)(void *, const char *))accept_listener_max_request_size,
+    },
+    {
+        .keyword="accept_batch",
+        .parse_arg=(int(*)(void *, const char *))accept_listener_accept_batch,
+    },
     {
         .keyword="access_log",
         .create=(void *(*)())new_logger_builder,
@@ -165,6 +230,26 @@ static struct Keyword global_grammar[] = {
         .keyword="pidfile",
         .parse_arg=(int(*)(void *, const char *))accept_pidfile,
     },
+    {
+        .keyword="pcre_jit",
+        .parse_arg=(int(*)(void *, const char *))accept_pcre_jit,
+    },
+    {
+        .keyword="workers",
+        .parse_arg=(int(*)(void *, const char *))accept_workers,
+    },
+    {
+        .keyword="worker_processes",
+        .parse_arg=(int(*)(void *, const char *))accept_worker_processes,
+    },
+    {
+        .keyword="cpu_affinity",
+        .parse_arg=(int(*)(void *, const char *))accept_cpu_affinity,
+    },
+    {
+        .keyword="event_backend",
+        .parse_arg=(int(*)(void *, const char *))accept_event_backend,
+    },
     {
         .keyword="resolver",
         .create=(void *(*)())new_resolver_config,
@@ -202,6 +287,20 @@ static struct Keyword global_grammar[] = {
     },
 };
 
+static const struct {
+    const char *name;
+    unsigned int backend;
+} event_backends[] = {
+    { "auto", 0 },
+    { "select", EVBACKEND_SELECT },
+    { "poll", EVBACKEND_POLL },
+    { "epoll", EVBACKEND_EPOLL },
+    { "kqueue", EVBACKEND_KQUEUE },
+#if HAVE_DECL_EVBACKEND_IOURING
+    { "io_uring", EVBACKEND_IOURING },
+#endif
+};
+
 static const char *const resolver_mode_names[] = {
     "DEFAULT",
     "ipv4_only",
@@ -221,6 +320,14 @@ init_config(const char *filename, struct ev_loop *loop) {
 
     SLIST_INIT(&config->listeners);
     SLIST_INIT(&config->tables);
+    config->pcre_jit = 1;
+    config->workers = DEFAULT_WORKERS;
+    config->worker_processes = DEFAULT_WORKERS;
+    config->resolver.cache_size = DEFAULT_RESOLV_CACHE_SIZE;
+    config->resolver.cache_min_ttl = DEFAULT_RESOLV_CACHE_MIN_TTL;
+    config->resolver.cache_max_ttl = DEFAULT_RESOLV_CACHE_MAX_TTL;
+    config->resolver.cache_negative_ttl = DEFAULT_RESOLV_CACHE_NEGATIVE_TTL;
+    config->resolver.cache_stale_ttl = DEFAULT_RESOLV_CACHE_STALE_TTL;
 
     config->filename = strdup(filename);
     if (config->filename == NULL) {
@@ -262,6 +369,23 @@ init_config(const char *filename, struct ev_loop *loop) {
         }
     }
 
+    if (config != NULL && config->workers > 1 &&
+            config->worker_processes > 1) {
+        err("workers and worker_processes can not both be used");
+        free_config(config, loop);
+        config = NULL;
+    }
+
+    if (config != NULL && config->workers > 1)
+        shard_listeners(&config->listeners, worker_cpu(config, 0));
+
+    /* Tables use the global regular expression JIT setting */
+    if (config != NULL) {
+        struct Table *table;
+        SLIST_FOREACH(table, &config->tables, entries)
+            table->pcre_jit = config->pcre_jit;
+    }
+
     return(config);
 }
 
@@ -271,6 +395,7 @@ free_config(struct Config *config, struct ev_loop *loop) {
     free(config->user);
     free(config->group);
     free(config->pidfile);
+    free(config->cpus);
 
     free_string_vector(config->resolver.nameservers);
     config->resolver.nameservers = NULL;
@@ -294,10 +419,33 @@ reload_config(struct Config *config, struct ev_loop *loop) {
         return;
     }
 
+    /* Workers are only started once, keep sharding added listeners between
+     * the running workers */
+    if (new_config->workers != config->workers ||
+            !cpu_affinity_equal(new_config, config)) {
+        if (new_config->workers != config->workers)
+            warn("changing workers from %zu to %zu requires a restart",
+                    config->workers, new_config->workers);
+        if (!cpu_affinity_equal(new_config, config))
+            warn("changing cpu_affinity requires a restart");
+
+        new_config->workers = config->workers;
+        if (config->workers > 1)
+            shard_listeners(&new_config->listeners, worker_cpu(config, 0));
+    }
+    if (new_config->worker_processes != config->worker_processes)
+        warn("changing worker_processes from %zu to %zu requires a restart",
+                config->worker_processes, new_config->worker_processes);
+    if (new_config->event_backend != config->event_backend)
+        warn("changing event_backend from %s to %s requires a restart",
+                event_backend_name(config->event_backend),
+                event_backend_name(new_config->event_backend));
+
     /* update access_log */
     logger_ref_put(config->access_log);
     config->access_log = logger_ref_get(new_config->access_log);
 
+    config->pcre_jit = new_config->pcre_jit;
     reload_tables(&config->tables, &new_config->tables);
 
     listeners_reload(&config->listeners, &new_config->listeners,
@@ -320,6 +468,28 @@ print_config(FILE *file, struct Config *config) {
     if (config->pidfile)
         fprintf(file, "pidfile %s\n\n", config->pidfile);
 
+    if (!config->pcre_jit)
+        fprintf(file, "pcre_jit off\n\n");
+
+    if (config->workers != DEFAULT_WORKERS)
+        fprintf(file, "workers %zu\n\n", config->workers);
+
+    if (config->worker_processes != DEFAULT_WORKERS)
+        fprintf(file, "worker_processes %zu\n\n", config->worker_processes);
+
+    if (config->cpu_affinity) {
+        fprintf(file, "cpu_affinity");
+        if (config->cpu_count == 0)
+            fprintf(file, " auto");
+        for (size_t i = 0; i < config->cpu_count; i++)
+            fprintf(file, " %d", config->cpus[i]);
+        fprintf(file, "\n\n");
+    }
+
+    if (config->event_backend != 0)
+        fprintf(file, "event_backend %s\n\n",
+                event_backend_name(config->event_backend));
+
     print_resolver_config(file, &config->resolver);
 
     SLIST_FOREACH(listener, &config->listeners, entries) {
@@ -331,6 +501,15 @@ print_config(FILE *file, struct Config *config) {
     }
 }
 
+const char *
+event_backend_name(unsigned int backend) {
+    for (size_t i = 0; i < sizeof(event_backends) / sizeof(event_backends[0]); i++)
+        if (event_backends[i].backend == backend)
+            return event_backends[i].name;
+
+    return "unknown";
+}
+
 static int
 accept_username(struct Config *config, const char *username) {
     if (config->user != NULL) {
@@ -376,6 +555,142 @@ accept_pidfile(struct Config *config, const char *pidfile) {
     return 1;
 }
 
+static int
+accept_event_backend(struct Config *config, const char *backend) {
+#if !HAVE_DECL_EVBACKEND_IOURING
+    if (strcasecmp(backend, "io_uring") == 0) {
+        err("io_uring event backend not supported in this build");
+        return 0;
+    }
+#endif
+
+    for (size_t i = 0; i < sizeof(event_backends) / sizeof(event_backends[0]); i++)
+        if (strcasecmp(event_backends[i].name, backend) == 0) {
+            config->event_backend = event_backends[i].backend;
+            return 1;
+        }
+
+    err("Invalid event_backend: %s", backend);
+    return 0;
+}
+
+static int
+accept_pcre_jit(struct Config *config, const char *pcre_jit) {
+    config->pcre_jit = parse_boolean(pcre_jit);
+    if (config->pcre_jit == -1) {
+        return 0;
+    }
+
+    return 1;
+}
+
+static int
+accept_workers(struct Config *config, const char *workers) {
+    return accept_worker_count("workers", workers, &config->workers);
+}
+
+static int
+accept_worker_processes(struct Config *config, const char *processes) {
+    return accept_worker_count("worker_processes", processes,
+            &config->worker_processes);
+}
+
+/*
+ * Either auto, off or a list of CPUs the workers are assigned in turn
+ */
+static int
+accept_cpu_affinity(struct Config *config, const char *value) {
+    if (!is_numeric(value)) {
+        if (config->cpu_count > 0) {
+            err("Invalid CPU: %s", value);
+            return 0;
+        } else if (strcasecmp(value, "auto") == 0) {
+            config->cpu_affinity = 1;
+        } else {
+            config->cpu_affinity = parse_boolean(value);
+            if (config->cpu_affinity == -1) {
+                err("Invalid cpu_affinity: %s", value);
+                return 0;
+            }
+        }
+    } else {
+        unsigned long cpu = strtoul(value, NULL, 10);
+#ifdef HAVE_SCHED_SETAFFINITY
+        if (cpu >= CPU_SETSIZE) {
+            err("CPU must be less than %d", CPU_SETSIZE);
+            return 0;
+        }
+#else
+        err("cpu_affinity not supported in this build");
+        return 0;
+#endif
+
+        int *cpus = realloc(config->cpus,
+                (config->cpu_count + 1) * sizeof(int));
+        if (cpus == NULL) {
+            err("%s: realloc", __func__);
+            return -1;
+        }
+
+        cpus[config->cpu_count++] = (int)cpu;
+        config->cpus = cpus;
+        config->cpu_affinity = 1;
+    }
+
+#ifndef HAVE_SCHED_SETAFFINITY
+    if (config->cpu_affinity == 1) {
+        err("cpu_affinity not supported in this build");
+        return 0;
+    }
+#endif
+
+    return 1;
+}
+
+static int
+cpu_affinity_equal(const struct Config *a, const struct Config *b) {
+    return a->cpu_affinity == b->cpu_affinity &&
+        a->cpu_count == b->cpu_count &&
+        (a->cpu_count == 0 ||
+            memcmp(a->cpus, b->cpus, a->cpu_count * sizeof(int)) == 0);
+}
+
+static int
+accept_worker_count(const char *description, const char *value,
+        size_t *count) {
+    if (!is_numeric(value)) {
+        err("Invalid %s: %s", description, value);
+        return 0;
+    }
+
+    *count = strtoul(value, NULL, 10);
+    if (*count < 1 || *count > MAX_WORKERS) {
+        err("%s must be between 1 and %d", description, MAX_WORKERS);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Each worker binds its own socket to every listening address, so the kernel
+ * distributes incoming connections between them. UNIX domain sockets can not
+ * be shared this way and are only served by the first worker. With
+ * cpu_affinity the kernel prefers the sockets of the first worker for
+ * connections processed by its CPU.
+ */
+static void
+shard_listeners(struct Listener_head *listeners, int incoming_cpu) {
+    struct Listener *listener;
+
+    SLIST_FOREACH(listener, listeners, entries) {
+        if (address_sa(listener->address)->sa_family != AF_UNIX) {
+            listener->reuseport = 1;
+            listener->incoming_cpu = incoming_cpu;
+        }
+    }
+}
+
 static int
 end_listener_stanza(struct Config *config, struct Listener *listener) {
     listener->accept_cb = &accept_connection;
@@ -570,6 +885,11 @@ new_resolver_config() {
         resolver->nameservers = NULL;
         resolver->search = NULL;
         resolver->mode = 0;
+        resolver->cache_size = DEFAULT_RESOLV_CACHE_SIZE;
+        resolver->cache_min_ttl = DEFAULT_RESOLV_CACHE_MIN_TTL;
+        resolver->cache_max_ttl = DEFAULT_RESOLV_CACHE_MAX_TTL;
+        resolver->cache_negative_ttl = DEFAULT_RESOLV_CACHE_NEGATIVE_TTL;
+        resolver->cache_stale_ttl = DEFAULT_RESOLV_CACHE_STALE_TTL;
     }
 
     return resolver;
@@ -653,6 +973,51 @@ accept_resolver_mode(struct ResolverConfig *resolver, const char *mode) {
     return -1;
 }
 
+static int
+accept_resolver_cache_size(struct ResolverConfig *resolver, const char *size) {
+    if (!is_numeric(size)) {
+        err("Invalid resolver cache size: %s", size);
+        return 0;
+    }
+
+    resolver->cache_size = strtoul(size, NULL, 10);
+
+    return 1;
+}
+
+static int
+accept_resolver_cache_min_ttl(struct ResolverConfig *resolver, const char *ttl) {
+    return parse_ttl(ttl, &resolver->cache_min_ttl);
+}
+
+static int
+accept_resolver_cache_max_ttl(struct ResolverConfig *resolver, const char *ttl) {
+    return parse_ttl(ttl, &resolver->cache_max_ttl);
+}
+
+static int
+accept_resolver_cache_negative_ttl(struct ResolverConfig *resolver, const char *ttl) {
+    return parse_ttl(ttl, &resolver->cache_negative_ttl);
+}
+
+static int
+accept_resolver_cache_stale_ttl(struct ResolverConfig *resolver, const char *ttl) {
+    return parse_ttl(ttl, &resolver->cache_stale_ttl);
+}
+
+static int
+parse_ttl(const char *ttl, unsigned int *result) {
+    if (!is_numeric(ttl)) {
+        err("Invalid resolver cache TTL: %s", ttl);
+        return 0;
+    }
+
+    unsigned long value = strtoul(ttl, NULL, 10);
+    *result = value < UINT_MAX ? (unsigned int)value : UINT_MAX;
+
+    return 1;
+}
+
 static int
 end_resolver_stanza(struct Config *config, struct ResolverConfig *resolver) {
     config->resolver = *resolver;
@@ -673,5 +1038,21 @@ print_resolver_config(FILE *file, struct ResolverConfig *resolver) {
 
     fprintf(file, "\tmode %s\n", resolver_mode_names[resolver->mode]);
 
+    if (resolver->cache_size != DEFAULT_RESOLV_CACHE_SIZE)
+        fprintf(file, "\tcache_size %zu\n", resolver->cache_size);
+
+    if (resolver->cache_min_ttl != DEFAULT_RESOLV_CACHE_MIN_TTL)
+        fprintf(file, "\tcache_min_ttl %u\n", resolver->cache_min_ttl);
+
+    if (resolver->cache_max_ttl != DEFAULT_RESOLV_CACHE_MAX_TTL)
+        fprintf(file, "\tcache_max_ttl %u\n", resolver->cache_max_ttl);
+
+    if (resolver->cache_negative_ttl != DEFAULT_RESOLV_CACHE_NEGATIVE_TTL)
+        fprintf(file, "\tcache_negative_ttl %u\n",
+                resolver->cache_negative_ttl);
+
+    if (resolver->cache_stale_ttl != DEFAULT_RESOLV_CACHE_STALE_TTL)
+        fprintf(file, "\tcache_stale_ttl %u\n", resolver->cache_stale_ttl);
+
     fprintf(file, "}\n\n");
 }
@@ -30,15 +30,30 @@
 #include "table.h"
 #include "listener.h"
 
+#define DEFAULT_WORKERS 1
+#define MAX_WORKERS 1024
+
 struct Config {
     char *filename;
     char *user;
     char *group;
     char *pidfile;
+    int pcre_jit;
+    size_t workers;
+    size_t worker_processes;
+    int cpu_affinity;
+    int *cpus;
+    size_t cpu_count;
+    unsigned int event_backend;
     struct ResolverConfig {
         char **nameservers;
         char **search;
         int mode;
+        size_t cache_size;
+        unsigned int cache_min_ttl;
+        unsigned int cache_max_ttl;
+        unsigned int cache_negative_ttl;
+        unsigned int cache_stale_ttl;
     } resolver;
     struct Logger *access_log;
     struct Listener_head listeners;
@@ -49,5 +64,6 @@ struct Config *init_config(const char *, struct ev_loop *);
 void reload_config(struct Config *, struct ev_loop *);
 void free_config(struct Config *, struct ev_loop *);
 void print_config(FILE *, struct Config *);
+const char *event_backend_name(unsigned int);
 
 #endif
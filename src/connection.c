@@ -44,12 +44,15 @@
 #include "address.h"
 #include "protocol.h"
 #include "logger.h"
+#include "pool.h"
 
 
 #define IS_TEMPORARY_SOCKERR(_errno) (_errno == EAGAIN || \
                                       _errno == EWOULDBLOCK || \
                                       _errno == EINTR)
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define CONNECTION_POOL_MAX_FREE 1024
+#define BUFFER_SHRINK_INTERVAL 5.0 /* seconds */
 
 
 struct resolv_cb_data {
@@ -60,7 +63,13 @@ struct resolv_cb_data {
 };
 
 
-static TAILQ_HEAD(ConnectionHead, Connection) connections;
+/* Each worker thread runs its own event loop with its own connections */
+static __thread TAILQ_HEAD(ConnectionHead, Connection) connections;
+/* Connections with grown buffers, in shrink_deadline order */
+static __thread TAILQ_HEAD(GrownConnectionHead, Connection) grown_connections;
+static __thread struct Pool connection_pool = POOL_INITIALIZER("connection",
+        sizeof(struct Connection), CONNECTION_POOL_MAX_FREE);
+static __thread struct ev_timer shrink_timer;
 
 
 static inline int client_socket_open(const struct Connection *);
@@ -69,18 +78,28 @@ static inline int server_socket_open(const struct Connection *);
 static void reactivate_watcher(struct ev_loop *, struct ev_io *,
         const struct Buffer *, const struct Buffer *);
 
+static inline void set_watcher_events(struct ev_io *, int);
 static void connection_cb(struct ev_loop *, struct ev_io *, int);
+static void shrink_timer_cb(struct ev_loop *, struct ev_timer *, int);
+static void grow_buffer(struct Connection *, struct Buffer *, size_t,
+        struct ev_loop *);
+static void schedule_shrink(struct Connection *, struct ev_loop *);
+static int shrink_buffer(struct Buffer *, ev_tstamp);
 static void resolv_cb(struct Address *, void *);
 static void reactivate_watchers(struct Connection *, struct ev_loop *);
 static void insert_proxy_v1_header(struct Connection *);
-static void parse_client_request(struct Connection *);
+static void parse_client_request(struct Connection *, struct ev_loop *);
 static void resolve_server_address(struct Connection *, struct ev_loop *);
 static void initiate_server_connect(struct Connection *, struct ev_loop *);
+static void splice_connection(struct Connection *);
 static void close_connection(struct Connection *, struct ev_loop *);
 static void close_client_socket(struct Connection *, struct ev_loop *);
-static void abort_connection(struct Connection *);
+static void abort_connection(struct Connection *, struct ev_loop *);
 static void close_server_socket(struct Connection *, struct ev_loop *);
-static struct Connection *new_connection(struct ev_loop *);
+static struct Connection *new_connection(const struct Listener *,
+        struct ev_loop *);
+static struct Buffer *new_connection_buffer(const struct Listener *,
+        struct ev_loop *);
 static void log_connection(struct Connection *);
 static void log_bad_request(struct Connection *, const char *, size_t, int);
 static void free_connection(struct Connection *);
@@ -91,6 +110,10 @@ static void free_resolv_cb_data(struct resolv_cb_data *);
 void
 init_connections() {
     TAILQ_INIT(&connections);
+    TAILQ_INIT(&grown_connections);
+
+    /* started by schedule_shrink() once a buffer grows */
+    ev_timer_init(&shrink_timer, shrink_timer_cb, 0.0, 0.0);
 }
 
 /**
@@ -100,28 +123,25 @@ init_connections() {
  */
 int
 accept_connection(struct Listener *listener, struct ev_loop *loop) {
-    struct Connection *con = new_connection(loop);
-    if (con == NULL) {
-        err("new_connection failed");
-        return 0;
-    }
-    con->listener = listener_ref_get(listener);
+    struct sockaddr_storage client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
 
 #ifdef HAVE_ACCEPT4
     int sockfd = accept4(listener->watcher.fd,
-                    (struct sockaddr *)&con->client.addr,
-                    &con->client.addr_len,
+                    (struct sockaddr *)&client_addr,
+                    &client_addr_len,
                     SOCK_NONBLOCK);
 #else
     int sockfd = accept(listener->watcher.fd,
-                    (struct sockaddr *)&con->client.addr,
-                    &con->client.addr_len);
+                    (struct sockaddr *)&client_addr,
+                    &client_addr_len);
 #endif
     if (sockfd < 0) {
         int saved_errno = errno;
 
-        warn("accept failed: %s", strerror(errno));
-        free_connection(con);
+        /* EAGAIN ends a batch of accepts normally, so is not logged */
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            warn("accept failed: %s", strerror(errno));
 
         errno = saved_errno;
         return 0;
@@ -132,11 +152,23 @@ accept_connection(struct Listener *listener, struct ev_loop *loop) {
     fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
 #endif
 
+    /* Only allocated once there is a connection to use it */
+    struct Connection *con = new_connection(listener, loop);
+    if (con == NULL) {
+        err("new_connection failed");
+        close(sockfd);
+        return 0;
+    }
+    con->listener = listener_ref_get(listener);
+    memcpy(&con->client.addr, &client_addr, client_addr_len);
+    con->client.addr_len = client_addr_len;
+
     if (getsockname(sockfd, (struct sockaddr *)&con->client.local_addr,
                 &con->client.local_addr_len) != 0) {
         int saved_errno = errno;
 
         warn("getsockname failed: %s", strerror(errno));
+        close(sockfd);
         free_connection(con);
 
         errno = saved_errno;
@@ -172,11 +204,16 @@ free_connections(struct ev_loop *loop) {
         close_connection(iter, loop);
         free_connection(iter);
     }
+
+    ev_timer_stop(loop, &shrink_timer);
+
+    pool_trim(&connection_pool);
+    free_buffer_pools();
 }
 
 /* dumps a list of all connections for debugging */
 void
-print_connections() {
+print_connections(const struct Listener_head *listeners) {
     char filename[] = "/tmp/sniproxy-connections-XXXXXX";
 
     int fd = mkstemp(filename);
@@ -196,12 +233,33 @@ print_connections() {
     TAILQ_FOREACH(iter, &connections, entries)
         print_connection(temp, iter);
 
+    fprintf(temp, "\nAccept batches:\n");
+    print_accept_stats(temp, listeners);
+
+    fprintf(temp, "\nMemory pools:\n");
+    print_pool_stats(temp, &connection_pool);
+    print_buffer_pool_stats(temp);
+
     if (fclose(temp) < 0)
         warn("fclose failed: %s", strerror(errno));
 
     notice("Dumped connections to %s", filename);
 }
 
+/*
+ * Returns the number of connections open on this thread's event loop
+ */
+size_t
+connection_count() {
+    struct Connection *iter;
+    size_t count = 0;
+
+    TAILQ_FOREACH(iter, &connections, entries)
+        count++;
+
+    return count;
+}
+
 /*
  * Test is client socket is open
  *
@@ -263,11 +321,18 @@ connection_cb(struct ev_loop *loop, struct ev_io *w, int revents) {
         } else if (bytes_received == 0) { /* peer closed socket */
             close_socket(con, loop);
             revents = 0;
+        } else if (bytes_received > 0 && con->state == CONNECTED &&
+                buffer_room(input_buffer) == 0 &&
+                !buffer_is_spliced(input_buffer)) {
+            /* bulk transfer, use fewer larger reads */
+            grow_buffer(con, input_buffer, con->listener->max_buffer_size,
+                    loop);
         }
     }
 
-    /* Transmit */
-    if (revents & EV_WRITE && buffer_len(output_buffer)) {
+    /* Transmit, the server buffer is not allocated until we connect */
+    if (revents & EV_WRITE && output_buffer != NULL &&
+            buffer_len(output_buffer)) {
         ssize_t bytes_transmitted = buffer_send(output_buffer, w->fd, 0, loop);
         if (bytes_transmitted < 0 && !IS_TEMPORARY_SOCKERR(errno)) {
             warn("send(%s): %s, closing connection",
@@ -281,14 +346,17 @@ connection_cb(struct ev_loop *loop, struct ev_io *w, int revents) {
     /* Handle any state specific logic, note we may transition through several
      * states during a single call */
     if (is_client && con->state == ACCEPTED)
-        parse_client_request(con);
+        parse_client_request(con, loop);
     if (is_client && con->state == PARSED)
         resolve_server_address(con, loop);
     if (is_client && con->state == RESOLVED)
         initiate_server_connect(con, loop);
+    if (con->splice_pending && con->state == CONNECTED)
+        splice_connection(con);
 
     /* Close other socket if we have flushed corresponding buffer */
-    if (con->state == SERVER_CLOSED && buffer_len(con->server.buffer) == 0)
+    if (con->state == SERVER_CLOSED &&
+            (con->server.buffer == NULL || buffer_len(con->server.buffer) == 0))
         close_client_socket(con, loop);
     if (con->state == CLIENT_CLOSED && buffer_len(con->client.buffer) == 0)
         close_server_socket(con, loop);
@@ -306,6 +374,88 @@ connection_cb(struct ev_loop *loop, struct ev_io *w, int revents) {
     reactivate_watchers(con, loop);
 }
 
+/*
+ * Shrink the buffers of grown connections once they have been idle for
+ * BUFFER_SHRINK_INTERVAL. Only connections whose shrink deadline has passed
+ * are visited, those still holding grown buffers are queued again.
+ */
+static void
+shrink_timer_cb(struct ev_loop *loop, struct ev_timer *w, int revents) {
+    ev_tstamp now = ev_now(loop);
+    ev_tstamp idle_since = now - BUFFER_SHRINK_INTERVAL;
+    struct Connection *con;
+
+    if (!(revents & EV_TIMER))
+        return;
+
+    while ((con = TAILQ_FIRST(&grown_connections)) != NULL &&
+            con->shrink_deadline <= now) {
+        TAILQ_REMOVE(&grown_connections, con, grown_entries);
+        con->shrink_deadline = 0.0;
+
+        int grown = shrink_buffer(con->client.buffer, idle_since);
+        if (con->server.buffer != NULL)
+            grown |= shrink_buffer(con->server.buffer, idle_since);
+
+        if (grown)
+            schedule_shrink(con, loop);
+    }
+
+    /* schedule_shrink() may have restarted the timer */
+    ev_timer_stop(loop, w);
+    if (con != NULL) {
+        ev_timer_set(w, con->shrink_deadline - now, 0.0);
+        ev_timer_start(loop, w);
+    }
+}
+
+static void
+grow_buffer(struct Connection *con, struct Buffer *buffer, size_t max_size,
+        struct ev_loop *loop) {
+    size_t size = buffer_size(buffer);
+
+    if (buffer_grow(buffer, max_size) < 0)
+        debug("Unable to grow buffer to %zu bytes", size * 2);
+    else if (buffer_size(buffer) > DEFAULT_BUFFER_SIZE)
+        schedule_shrink(con, loop);
+}
+
+/*
+ * Queue a connection with a grown buffer to be checked for shrinking after
+ * BUFFER_SHRINK_INTERVAL. Deadlines are always that interval from now so
+ * appending keeps the queue in deadline order.
+ */
+static void
+schedule_shrink(struct Connection *con, struct ev_loop *loop) {
+    if (con->shrink_deadline > 0.0)
+        return; /* already queued */
+
+    con->shrink_deadline = ev_now(loop) + BUFFER_SHRINK_INTERVAL;
+    TAILQ_INSERT_TAIL(&grown_connections, con, grown_entries);
+
+    if (!ev_is_active(&shrink_timer)) {
+        ev_timer_set(&shrink_timer, BUFFER_SHRINK_INTERVAL, 0.0);
+        ev_timer_start(loop, &shrink_timer);
+    }
+}
+
+/*
+ * Shrink a buffer with no activity since idle_since to the smallest size
+ * holding its content, returns 1 if it remains larger than
+ * DEFAULT_BUFFER_SIZE and could be shrunk later
+ */
+static int
+shrink_buffer(struct Buffer *buffer, ev_tstamp idle_since) {
+    if (buffer_size(buffer) <= DEFAULT_BUFFER_SIZE || buffer->read_only ||
+            buffer_is_spliced(buffer))
+        return 0;
+
+    if (MAX(buffer->last_recv, buffer->last_send) < idle_since)
+        buffer_shrink(buffer, DEFAULT_BUFFER_SIZE);
+
+    return buffer_size(buffer) > DEFAULT_BUFFER_SIZE;
+}
+
 static void
 reactivate_watchers(struct Connection *con, struct ev_loop *loop) {
     struct ev_io *client_watcher = &con->client.watcher;
@@ -344,7 +494,7 @@ reactivate_watcher(struct ev_loop *loop, struct ev_io *w,
     if (buffer_room(input_buffer))
         events |= EV_READ;
 
-    if (buffer_len(output_buffer))
+    if (output_buffer != NULL && buffer_len(output_buffer))
         events |= EV_WRITE;
 
     if (ev_is_active(w)) {
@@ -352,15 +502,30 @@ reactivate_watcher(struct ev_loop *loop, struct ev_io *w,
             ev_io_stop(loop, w);
         else if (events != w->events) {
             ev_io_stop(loop, w);
-            ev_io_set(w, w->fd, events);
+            set_watcher_events(w, events);
             ev_io_start(loop, w);
         }
     } else if (events != 0) {
-        ev_io_set(w, w->fd, events);
+        set_watcher_events(w, events);
         ev_io_start(loop, w);
     }
 }
 
+/*
+ * Change the events of a stopped watcher on the same file descriptor. Unlike
+ * ev_io_set(), ev_io_modify() does not mark the descriptor as new, so libev
+ * only updates the backend when the combined events of the descriptor
+ * actually change, rather than on every restart.
+ */
+static inline void
+set_watcher_events(struct ev_io *w, int events) {
+#if HAVE_DECL_EV_IO_MODIFY
+    ev_io_modify(w, events);
+#else
+    ev_io_set(w, w->fd, events);
+#endif
+}
+
 static void
 insert_proxy_v1_header(struct Connection *con) {
     char buf[INET6_ADDRSTRLEN] = { '\0' };
@@ -431,10 +596,9 @@ insert_proxy_v1_header(struct Connection *con) {
 }
 
 static void
-parse_client_request(struct Connection *con) {
+parse_client_request(struct Connection *con, struct ev_loop *loop) {
     const char *payload;
     size_t payload_len = buffer_coalesce(con->client.buffer, (const void **)&payload);
-    char *hostname = NULL;
 
     /* Avoid payload_len underflow and empty request */
     if (payload_len <= con->header_len)
@@ -443,14 +607,23 @@ parse_client_request(struct Connection *con) {
     payload += con->header_len;
     payload_len -= con->header_len;
 
-    int result = con->listener->protocol->parse_packet(payload, payload_len, &hostname);
+    int result = con->listener->protocol->resume_parse(payload, payload_len,
+            con->hostname_buf, &con->parse_state);
     if (result < 0) {
         char client[INET6_ADDRSTRLEN + 8];
 
         if (result == -1) { /* incomplete request */
+            size_t size = buffer_size(con->client.buffer);
+
             if (buffer_room(con->client.buffer) > 0)
                 return; /* give client a chance to send more data */
 
+            if (size < con->listener->max_request_size &&
+                    buffer_resize(con->client.buffer, size * 2) >= 0) {
+                schedule_shrink(con, loop);
+                return; /* make room for the rest of the request */
+            }
+
             warn("Request from %s exceeded %zu byte buffer size",
                     display_sockaddr(&con->client.addr, client, sizeof(client)),
                     buffer_size(con->client.buffer));
@@ -467,23 +640,31 @@ parse_client_request(struct Connection *con) {
         }
 
         if (con->listener->fallback_address == NULL) {
-            abort_connection(con);
+            abort_connection(con, loop);
             return;
         }
     }
 
-    con->hostname = hostname;
+    if (result >= 0)
+        con->hostname = con->hostname_buf;
     con->hostname_len = (size_t)result;
     con->state = PARSED;
 }
 
+/*
+ * Send the protocol's abort message to the client and close the connection,
+ * the abort message is sent from a read only buffer referring to the
+ * protocol's constant copy. If the buffer can not be allocated the client is
+ * closed without it.
+ */
 static void
-abort_connection(struct Connection *con) {
+abort_connection(struct Connection *con, struct ev_loop *loop) {
     assert(client_socket_open(con));
+    assert(con->server.buffer == NULL);
 
-    buffer_push(con->server.buffer,
+    con->server.buffer = new_read_only_buffer(
             con->listener->protocol->abort_message,
-            con->listener->protocol->abort_message_len);
+            con->listener->protocol->abort_message_len, loop);
 
     con->state = SERVER_CLOSED;
 }
@@ -491,10 +672,12 @@ abort_connection(struct Connection *con) {
 static void
 resolve_server_address(struct Connection *con, struct ev_loop *loop) {
     struct LookupResult result =
-        listener_lookup_server_address(con->listener, con->hostname, con->hostname_len);
+        listener_lookup_server_address(con->listener,
+                con->hostname, con->hostname_len,
+                con->parse_state.alpn, con->parse_state.alpn_len);
 
     if (result.address == NULL) {
-        abort_connection(con);
+        abort_connection(con, loop);
         return;
     } else if (address_is_hostname(result.address)) {
 #ifndef HAVE_LIBUDNS
@@ -503,7 +686,7 @@ resolve_server_address(struct Connection *con, struct ev_loop *loop) {
         if (result.caller_free_address)
             free((void *)result.address);
 
-        abort_connection(con);
+        abort_connection(con, loop);
         return;
 #else
         struct resolv_cb_data *cb_data = malloc(sizeof(struct resolv_cb_data));
@@ -513,7 +696,7 @@ resolve_server_address(struct Connection *con, struct ev_loop *loop) {
             if (result.caller_free_address)
                 free((void *)result.address);
 
-            abort_connection(con);
+            abort_connection(con, loop);
             return;
         }
         cb_data->connection = con;
@@ -580,7 +763,7 @@ resolv_cb(struct Address *result, void *data) {
     if (result == NULL) {
         notice("unable to resolve %s, closing connection",
                 address_hostname(cb_data->address));
-        abort_connection(con);
+        abort_connection(con, loop);
     } else {
         assert(address_is_sockaddr(result));
 
@@ -619,7 +802,7 @@ initiate_server_connect(struct Connection *con, struct ev_loop *loop) {
         warn("socket failed: %s, closing connection from %s",
                 strerror(errno),
                 display_sockaddr(&con->client.addr, client, sizeof(client)));
-        abort_connection(con);
+        abort_connection(con, loop);
         return;
     }
 
@@ -641,7 +824,7 @@ initiate_server_connect(struct Connection *con, struct ev_loop *loop) {
         if (result < 0) {
             err("setsockopt IP_TRANSPARENT failed: %s", strerror(errno));
             close(sockfd);
-            abort_connection(con);
+            abort_connection(con, loop);
             return;
         }
 
@@ -650,7 +833,7 @@ initiate_server_connect(struct Connection *con, struct ev_loop *loop) {
         if (result < 0) {
             err("bind failed: %s", strerror(errno));
             close(sockfd);
-            abort_connection(con);
+            abort_connection(con, loop);
             return;
         }
     } else if (con->listener->source_address) {
@@ -659,7 +842,7 @@ initiate_server_connect(struct Connection *con, struct ev_loop *loop) {
         if (result < 0) {
             err("setsockopt SO_REUSEADDR failed: %s", strerror(errno));
             close(sockfd);
-            abort_connection(con);
+            abort_connection(con, loop);
             return;
         }
 
@@ -675,7 +858,7 @@ initiate_server_connect(struct Connection *con, struct ev_loop *loop) {
         if (result < 0) {
             err("bind failed: %s", strerror(errno));
             close(sockfd);
-            abort_connection(con);
+            abort_connection(con, loop);
             return;
         }
     }
@@ -690,7 +873,7 @@ initiate_server_connect(struct Connection *con, struct ev_loop *loop) {
         warn("Failed to open connection to %s: %s",
                 display_sockaddr(&con->server.addr, server, sizeof(server)),
                 strerror(errno));
-        abort_connection(con);
+        abort_connection(con, loop);
         return;
     }
 
@@ -699,7 +882,16 @@ initiate_server_connect(struct Connection *con, struct ev_loop *loop) {
         close(sockfd);
         warn("getsockname failed: %s", strerror(errno));
 
-        abort_connection(con);
+        abort_connection(con, loop);
+        return;
+    }
+
+    con->server.buffer = new_connection_buffer(con->listener, loop);
+    if (con->server.buffer == NULL) {
+        close(sockfd);
+        err("%s: unable to allocate server buffer", __func__);
+
+        abort_connection(con, loop);
         return;
     }
 
@@ -713,10 +905,39 @@ initiate_server_connect(struct Connection *con, struct ev_loop *loop) {
     ev_io_init(server_watcher, connection_cb, sockfd, EV_WRITE);
     con->server.watcher.data = con;
     con->state = CONNECTED;
+    con->splice_pending = con->listener->splice;
 
     ev_io_start(loop, server_watcher);
 }
 
+/*
+ * Move each direction of the connection to a splice(2) relay once the data
+ * already buffered in user space has been sent, the client buffer still holds
+ * the initial request at this point. If a pipe can not be created we continue
+ * using the existing buffers.
+ */
+static void
+splice_connection(struct Connection *con) {
+    struct Buffer *buffers[] = { con->client.buffer, con->server.buffer };
+    int spliced = 0;
+
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++) {
+        if (buffer_is_spliced(buffers[i])) {
+            spliced++;
+        } else if (buffer_len(buffers[i]) == 0) {
+            if (!buffer_splice(buffers[i])) {
+                warn("splice relay unavailable, using buffered relay");
+                con->splice_pending = 0;
+                return;
+            }
+            spliced++;
+        }
+    }
+
+    if (spliced == sizeof(buffers) / sizeof(buffers[0]))
+        con->splice_pending = 0;
+}
+
 /* Close client socket.
  * Caller must ensure that it has not been closed before.
  */
@@ -790,11 +1011,12 @@ close_connection(struct Connection *con, struct ev_loop *loop) {
  * Allocate and initialize a new connection
  */
 static struct Connection *
-new_connection(struct ev_loop *loop) {
-    struct Connection *con = calloc(1, sizeof(struct Connection));
+new_connection(const struct Listener *listener, struct ev_loop *loop) {
+    struct Connection *con = pool_alloc(&connection_pool);
     if (con == NULL)
         return NULL;
 
+    memset(con, 0, sizeof(struct Connection));
     con->state = NEW;
     con->client.addr_len = sizeof(con->client.addr);
     con->client.local_addr = (struct sockaddr_storage){.ss_family = AF_UNSPEC};
@@ -804,29 +1026,41 @@ new_connection(struct ev_loop *loop) {
     con->server.local_addr_len = sizeof(con->server.local_addr);
     con->hostname = NULL;
     con->hostname_len = 0;
+    con->hostname_buf[0] = '\0';
     con->header_len = 0;
+    con->parse_state = (struct ParseState){ .offset = 0, .need = 0 };
     con->query_handle = NULL;
     con->use_proxy_header = 0;
+    con->splice_pending = 0;
+    con->shrink_deadline = 0.0;
 
-    con->client.buffer = new_buffer(4096, loop);
+    con->client.buffer = new_connection_buffer(listener, loop);
     if (con->client.buffer == NULL) {
         free_connection(con);
         return NULL;
     }
 
-    con->server.buffer = new_buffer(4096, loop);
-    if (con->server.buffer == NULL) {
-        free_connection(con);
-        return NULL;
-    }
+    /* server buffer is allocated by initiate_server_connect() */
+    con->server.buffer = NULL;
 
     return con;
 }
 
+static struct Buffer *
+new_connection_buffer(const struct Listener *listener, struct ev_loop *loop) {
+    if (listener->mirrored_buffers)
+        return new_mirrored_buffer(DEFAULT_BUFFER_SIZE, loop);
+
+    return new_buffer(DEFAULT_BUFFER_SIZE, loop);
+}
+
 static void
 log_connection(struct Connection *con) {
+    static const struct Buffer unconnected = { .pipe = { -1, -1 } };
+    const struct Buffer *server_buffer =
+        con->server.buffer != NULL ? con->server.buffer : &unconnected;
     ev_tstamp duration = MAX(con->client.buffer->last_recv,
-                             con->server.buffer->last_recv) -
+                             server_buffer->last_recv) -
                          con->established_timestamp;
     char client_address[ADDRESS_BUFFER_SIZE];
     char listener_address[ADDRESS_BUFFER_SIZE];
@@ -845,8 +1079,8 @@ log_connection(struct Connection *con) {
            server_address,
            (int)con->hostname_len,
            con->hostname,
-           con->server.buffer->tx_bytes,
-           con->server.buffer->rx_bytes,
+           server_buffer->tx_bytes,
+           server_buffer->rx_bytes,
            con->client.buffer->tx_bytes,
            con->client.buffer->rx_bytes,
            duration);
@@ -888,11 +1122,13 @@ free_connection(struct Connection *con) {
     if (con == NULL)
         return;
 
+    if (con->shrink_deadline > 0.0)
+        TAILQ_REMOVE(&grown_connections, con, grown_entries);
+
     listener_ref_put(con->listener);
     free_buffer(con->client.buffer);
     free_buffer(con->server.buffer);
-    free((void *)con->hostname); /* cast away const'ness */
-    free(con);
+    pool_free(&connection_pool, con);
 }
 
 static void
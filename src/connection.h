@@ -31,6 +31,7 @@
 #include <ev.h>
 #include "listener.h"
 #include "buffer.h"
+#include "protocol.h"
 
 struct Connection {
     enum State {
@@ -52,19 +53,25 @@ struct Connection {
         struct Buffer *buffer;
     } client, server;
     struct Listener *listener;
-    const char *hostname; /* Requested hostname */
+    const char *hostname; /* Requested hostname, NULL or hostname_buf */
     size_t hostname_len;
+    char hostname_buf[HOSTNAME_MAX_LEN + 1];
     size_t header_len;
+    struct ParseState parse_state; /* progress parsing the client request */
     struct ResolvQuery *query_handle;
     ev_tstamp established_timestamp;
     int use_proxy_header;
+    int splice_pending;     /* relay through splice(2) once buffers flush */
+    ev_tstamp shrink_deadline; /* queued to shrink buffers, 0 if not queued */
 
     TAILQ_ENTRY(Connection) entries;
+    TAILQ_ENTRY(Connection) grown_entries;
 };
 
 void init_connections();
 int accept_connection(struct Listener *, struct ev_loop *);
 void free_connections(struct ev_loop *);
-void print_connections();
+void print_connections(const struct Listener_head *);
+size_t connection_count();
 
 #endif
@@ -24,19 +24,21 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 #include <stdio.h>
-#include <stdlib.h> /* malloc() */
-#include <string.h> /* strncpy() */
+#include <string.h> /* strlen(), memchr() */
 #include <strings.h> /* strncasecmp() */
 #include <ctype.h> /* isblank(), isdigit() */
 #include "http.h"
+#include "http_scan.h"
 #include "protocol.h"
 
-#define SERVER_NAME_LEN 256
 
 
 static int parse_http_header(const char *, size_t, char **);
-static int get_header(const char *, const char *, size_t, char **);
-static size_t next_header(const char **, size_t *);
+static int resume_http_header(const char *, size_t, char *,
+        struct ParseState *);
+static int get_header(const char *, const char *, size_t, char *, size_t *);
+static size_t strip_port(const char *, size_t);
+static size_t next_line(const char *, size_t);
 
 
 static const char http_503[] =
@@ -49,6 +51,7 @@ const struct Protocol *const http_protocol = &(struct Protocol){
     .name = "http",
     .default_port = 80,
     .parse_packet = &parse_http_header,
+    .resume_parse = &resume_http_header,
     .abort_message = http_503,
     .abort_message_len = sizeof(http_503) - 1,
 };
@@ -68,86 +71,117 @@ const struct Protocol *const http_protocol = &(struct Protocol){
  */
 static int
 parse_http_header(const char* data, size_t data_len, char **hostname) {
-    int result, i;
+    return parse_packet_copy(&resume_http_header, data, data_len, hostname);
+}
 
+/*
+ * As parse_http_header(), but header lines examined by a previous call with
+ * the same state are skipped and the hostname is copied to the
+ * HOSTNAME_MAX_LEN + 1 byte buffer hostname
+ */
+static int
+resume_http_header(const char* data, size_t data_len, char *hostname,
+        struct ParseState *state) {
     if (hostname == NULL)
         return -3;
 
-    result = get_header("Host:", data, data_len, hostname);
-    if (result < 0)
-        return result;
+    return get_header("Host:", data, data_len, hostname, &state->offset);
+}
 
-    /*
-     *  if the user specifies the port in the request, it is included here.
-     *  Host: example.com:80
-     *  Host: [2001:db8::1]:8080
-     *  so we trim off port portion
-     */
-    for (i = result - 1; i >= 0; i--)
-        if ((*hostname)[i] == ':') {
-            (*hostname)[i] = '\0';
-            result = i;
-            break;
-        } else if (!isdigit((*hostname)[i])) {
+/*
+ *  if the user specifies the port in the request, it is included here.
+ *  Host: example.com:80
+ *  Host: [2001:db8::1]:8080
+ *  so we trim off port portion, before the length of the hostname is checked
+ *
+ *  Returns the length of value without the port
+ */
+static size_t
+strip_port(const char *value, size_t len) {
+    for (size_t i = len; i > 0; i--)
+        if (value[i - 1] == ':')
+            return i - 1;
+        else if (!isdigit((unsigned char)value[i - 1]))
             break;
-        }
 
-    return result;
+    return len;
 }
 
+/*
+ * Search the complete header lines starting at *offset, the request line at
+ * offset zero is skipped. Only lines which could be the header or the end of
+ * the headers are examined, see http_find_line(). *offset is advanced past
+ * each line skipped, so the search can be resumed once more data is received.
+ */
 static int
-get_header(const char *header, const char *data, size_t data_len, char **value) {
-    size_t len, header_len;
+get_header(const char *header, const char *data, size_t data_len, char *value,
+        size_t *offset) {
+    size_t pos = *offset;
+    size_t len, next, header_len;
 
     header_len = strlen(header);
 
-    /* loop through headers stopping at first blank line */
-    while ((len = next_header(&data, &data_len)) != 0)
-        if (len > header_len && strncasecmp(header, data, header_len) == 0) {
-            /* Eat leading whitespace */
-            while (header_len < len && isblank(data[header_len]))
-                header_len++;
+    for (;;) {
+        if (pos != 0 && data_len - pos >= 2 &&
+                data[pos] == '\r' && data[pos + 1] == '\n')
+            return -2; /* end of headers */
+
+        if (pos != 0 && data_len - pos > header_len &&
+                strncasecmp(header, data + pos, header_len) == 0) {
+            const char *line = data + pos;
 
-            *value = malloc(len - header_len + 1);
-            if (*value == NULL)
-                return -4;
+            len = next_line(line, data_len - pos);
+            if (len == (size_t)-1)
+                return -1; /* resume at this line */
 
-            strncpy(*value, data + header_len, len - header_len);
-            (*value)[len - header_len] = '\0';
+            if (len > header_len) {
+                /* Eat leading whitespace */
+                while (header_len < len && isblank(line[header_len]))
+                    header_len++;
 
-            return len - header_len;
+                return copy_hostname(value, line + header_len,
+                        strip_port(line + header_len, len - header_len));
+            }
         }
 
-    /* If there is no data left after reading all the headers then we do not
-     * have a complete HTTP request, there must be a blank line */
-    if (data_len == 0)
-        return -1;
+        next = http_find_line(data + pos, data_len - pos, header[0]);
+        if (next == (size_t)-1)
+            break;
+
+        pos += next;
+        *offset = pos;
+    }
+
+    /*
+     * Any complete lines following pos were not candidates, resume at the
+     * start of the last, incomplete, line
+     */
+    for (size_t i = data_len; i > pos + 1; i--)
+        if (data[i - 1] == '\n' && data[i - 2] == '\r') {
+            *offset = i;
+            break;
+        }
 
-    return -2;
+    /* there must be a blank line to have a complete HTTP request */
+    return -1;
 }
 
+/*
+ * Returns the length of the line at the start of data excluding the
+ * terminating <CR><LF>, or (size_t)-1 if data does not contain a complete line
+ */
 static size_t
-next_header(const char **data, size_t *len) {
-    size_t header_len;
-
-    /* perhaps we can optimize this to reuse the value of header_len, rather
-     * than scanning twice.
-     * Walk our data stream until the end of the header */
-    while (*len > 2 && (*data)[0] != '\r' && (*data)[1] != '\n') {
-        (*len)--;
-        (*data)++;
-    }
+next_line(const char *data, size_t len) {
+    const char *cr;
+    size_t pos = 0;
 
-    /* advanced past the <CR><LF> pair */
-    *data += 2;
-    *len -= 2;
+    while (pos < len && (cr = memchr(data + pos, '\r', len - pos)) != NULL) {
+        pos = (size_t)(cr - data);
+        if (pos + 1 < len && data[pos + 1] == '\n')
+            return pos;
 
-    /* Find the length of the next header */
-    header_len = 0;
-    while (*len > header_len + 1
-            && (*data)[header_len] != '\r'
-            && (*data)[header_len + 1] != '\n')
-        header_len++;
+        pos++;
+    }
 
-    return header_len;
+    return (size_t)-1;
 }
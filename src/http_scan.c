@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2026, agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <string.h> /* memchr() */
+#include "http_scan.h"
+
+#ifdef HTTP_SCAN_X86
+#include <immintrin.h>
+#endif
+
+
+/*
+ * Header lines are located by searching for a <LF> preceded by <CR> and
+ * followed by the first character of the wanted header name or by <CR>, the
+ * start of the blank line ending the headers. Lines in between, such as long
+ * Cookie headers, are skipped without being examined individually.
+ *
+ * Each http_find_line function returns the offset of the first line start
+ * after data[0] whose first character is first, compared case insensitively
+ * for letters, or <CR>; or (size_t)-1 if data contains no such line start.
+ * All implementations return identical results.
+ */
+#define IS_CANDIDATE(c, lower) \
+    ((((unsigned char)(c) | 0x20) == (lower)) || (c) == '\r')
+
+
+static size_t find_line_from(const char *, size_t, unsigned char, size_t);
+
+size_t
+http_find_line(const char *data, size_t len, char first) {
+#ifdef HTTP_SCAN_X86
+    if (http_scan_avx2_supported())
+        return http_find_line_avx2(data, len, first);
+
+    /* SSE2 is part of the x86-64 baseline */
+    return http_find_line_sse2(data, len, first);
+#else
+    return http_find_line_scalar(data, len, first);
+#endif
+}
+
+size_t
+http_find_line_scalar(const char *data, size_t len, char first) {
+    return find_line_from(data, len, (unsigned char)first | 0x20, 1);
+}
+
+/*
+ * Search for line starts following a <LF> at or after pos
+ */
+static size_t
+find_line_from(const char *data, size_t len, unsigned char lower, size_t pos) {
+    const char *lf;
+
+    while (pos + 1 < len &&
+            (lf = memchr(data + pos, '\n', len - pos - 1)) != NULL) {
+        pos = (size_t)(lf - data);
+        if (data[pos - 1] == '\r' && IS_CANDIDATE(data[pos + 1], lower))
+            return pos + 1;
+
+        pos++;
+    }
+
+    return (size_t)-1;
+}
+
+#ifdef HTTP_SCAN_X86
+int
+http_scan_avx2_supported(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+/*
+ * Each 32 or 64 byte chunk is first tested for any <LF>, which is all most of
+ * a long header line needs. Blocks containing a <LF> compare the bytes at
+ * pos - 1 and pos + 1 as well, using unaligned loads so no state is carried
+ * between blocks. The remainder shorter than a chunk is scanned by the scalar
+ * implementation.
+ */
+static inline unsigned int
+block_sse2(const char *data, __m128i lf, __m128i cur, __m128i name) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i fold = _mm_set1_epi8(0x20);
+    __m128i prev = _mm_loadu_si128((const __m128i *)(data - 1));
+    __m128i next = _mm_loadu_si128((const __m128i *)(data + 1));
+
+    __m128i crlf = _mm_and_si128(_mm_cmpeq_epi8(prev, cr),
+            _mm_cmpeq_epi8(cur, lf));
+    __m128i candidate = _mm_or_si128(
+            _mm_cmpeq_epi8(_mm_or_si128(next, fold), name),
+            _mm_cmpeq_epi8(next, cr));
+
+    return (unsigned int)_mm_movemask_epi8(_mm_and_si128(crlf, candidate));
+}
+
+size_t
+http_find_line_sse2(const char *data, size_t len, char first) {
+    unsigned char lower = (unsigned char)first | 0x20;
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i name = _mm_set1_epi8((char)lower);
+    size_t pos = 1;
+
+    for (; pos + 33 <= len; pos += 32) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(data + pos));
+        __m128i b = _mm_loadu_si128((const __m128i *)(data + pos + 16));
+        unsigned int mask;
+
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(a, lf),
+                        _mm_cmpeq_epi8(b, lf))) == 0)
+            continue;
+
+        mask = block_sse2(data + pos, lf, a, name);
+        if (mask != 0)
+            return pos + (size_t)__builtin_ctz(mask) + 1;
+
+        mask = block_sse2(data + pos + 16, lf, b, name);
+        if (mask != 0)
+            return pos + 16 + (size_t)__builtin_ctz(mask) + 1;
+    }
+
+    return find_line_from(data, len, lower, pos);
+}
+
+__attribute__((target("avx2")))
+static inline unsigned int
+block_avx2(const char *data, __m256i lf, __m256i cur, __m256i name) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i fold = _mm256_set1_epi8(0x20);
+    __m256i prev = _mm256_loadu_si256((const __m256i *)(data - 1));
+    __m256i next = _mm256_loadu_si256((const __m256i *)(data + 1));
+
+    __m256i crlf = _mm256_and_si256(_mm256_cmpeq_epi8(prev, cr),
+            _mm256_cmpeq_epi8(cur, lf));
+    __m256i candidate = _mm256_or_si256(
+            _mm256_cmpeq_epi8(_mm256_or_si256(next, fold), name),
+            _mm256_cmpeq_epi8(next, cr));
+
+    return (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(crlf, candidate));
+}
+
+__attribute__((target("avx2")))
+size_t
+http_find_line_avx2(const char *data, size_t len, char first) {
+    unsigned char lower = (unsigned char)first | 0x20;
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i name = _mm256_set1_epi8((char)lower);
+    size_t pos = 1;
+
+    for (; pos + 65 <= len; pos += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(data + pos));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(data + pos + 32));
+        unsigned int mask;
+
+        if (_mm256_testz_si256(_mm256_or_si256(_mm256_cmpeq_epi8(a, lf),
+                        _mm256_cmpeq_epi8(b, lf)),
+                    _mm256_set1_epi8(-1)))
+            continue;
+
+        mask = block_avx2(data + pos, lf, a, name);
+        if (mask != 0)
+            return pos + (size_t)__builtin_ctz(mask) + 1;
+
+        mask = block_avx2(data + pos + 32, lf, b, name);
+        if (mask != 0)
+            return pos + 32 + (size_t)__builtin_ctz(mask) + 1;
+    }
+
+    return find_line_from(data, len, lower, pos);
+}
+#endif
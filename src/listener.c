@@ -43,46 +43,27 @@
 #include "address.h"
 #include "listener.h"
 #include "logger.h"
+#include "cfg_parser.h"
+#include "lookup_cache.h"
 #include "binder.h"
 #include "protocol.h"
 #include "tls.h"
 #include "http.h"
 
+#define DEFAULT_LOOKUP_CACHE_SIZE 1024
+
 static void close_listener(struct ev_loop *, struct Listener *);
 static void accept_cb(struct ev_loop *, struct ev_io *, int);
 static void backoff_timer_cb(struct ev_loop *, struct ev_timer *, int);
+static void record_accept_batch(struct AcceptStats *, size_t, int);
 static int init_listener(struct Listener *, const struct Table_head *, struct ev_loop *);
 static void listener_update(struct Listener *, struct Listener *,  const struct Table_head *);
 static void free_listener(struct Listener *);
-static int parse_boolean(const char *);
-
-
-static int
-parse_boolean(const char *boolean) {
-    const char *boolean_true[] = {
-        "yes",
-        "true",
-        "on",
-    };
+static struct LookupResult lookup_server_address(const struct Listener *,
+        const char *, size_t, const char *, size_t);
+static struct LookupResult cached_lookup_result(const struct LookupResult *);
+static int accept_buffer_size(const char *, const char *, size_t *);
 
-    const char *boolean_false[] = {
-        "no",
-        "false",
-        "off",
-    };
-
-    for (size_t i = 0; i < sizeof(boolean_true) / sizeof(boolean_true[0]); i++)
-        if (strcasecmp(boolean, boolean_true[i]) == 0)
-            return 1;
-
-    for (size_t i = 0; i < sizeof(boolean_false) / sizeof(boolean_false[0]); i++)
-        if (strcasecmp(boolean, boolean_false[i]) == 0)
-            return 0;
-
-    err("Unable to parse '%s' as a boolean value", boolean);
-
-    return -1;
-}
 
 /*
  * Initialize each listener.
@@ -186,6 +167,19 @@ listener_update(struct Listener *existing_listener, struct Listener *new_listene
     existing_listener->access_log = logger_ref_get(new_listener->access_log);
 
     existing_listener->log_bad_requests = new_listener->log_bad_requests;
+    existing_listener->splice = new_listener->splice;
+    existing_listener->mirrored_buffers = new_listener->mirrored_buffers;
+    existing_listener->max_buffer_size = new_listener->max_buffer_size;
+    existing_listener->max_request_size = new_listener->max_request_size;
+    existing_listener->accept_batch = new_listener->accept_batch;
+
+    /* Cached results may refer to the old fallback address */
+    existing_listener->lookup_cache_size = new_listener->lookup_cache_size;
+    free_lookup_cache(existing_listener->lookup_cache);
+    existing_listener->lookup_cache = NULL;
+    if (existing_listener->lookup_cache_size > 0)
+        existing_listener->lookup_cache =
+            new_lookup_cache(existing_listener->lookup_cache_size);
 
     struct Table *new_table =
             table_lookup(tables, existing_listener->table_name);
@@ -218,18 +212,83 @@ new_listener() {
     listener->log_bad_requests = 0;
     listener->reuseport = 0;
     listener->ipv6_v6only = 0;
+    listener->incoming_cpu = -1;
     listener->transparent_proxy = 0;
+    listener->splice = 0;
+    listener->mirrored_buffers = 0;
     listener->fallback_use_proxy_header = 0;
+    listener->lookup_cache_size = DEFAULT_LOOKUP_CACHE_SIZE;
+    listener->max_buffer_size = DEFAULT_MAX_BUFFER_SIZE;
+    listener->max_request_size = DEFAULT_MAX_REQUEST_SIZE;
+    listener->accept_batch = DEFAULT_ACCEPT_BATCH;
     listener->reference_count = 0;
     /* Initializes sock fd to negative sentinel value to indicate watchers
      * are not active */
     ev_io_init(&listener->watcher, accept_cb, -1, EV_READ);
     ev_timer_init(&listener->backoff_timer, backoff_timer_cb, 0.0, 0.0);
     listener->table = NULL;
+    listener->lookup_cache = NULL;
 
     return listener;
 }
 
+/*
+ * Copy the configuration of a listener, so another event loop can accept
+ * connections on the same address using its own socket and lookup cache
+ */
+struct Listener *
+clone_listener(const struct Listener *listener) {
+    struct Listener *clone = new_listener();
+    if (clone == NULL)
+        return NULL;
+
+    clone->address = copy_address(listener->address);
+    if (clone->address == NULL)
+        goto error;
+
+    if (listener->fallback_address != NULL) {
+        clone->fallback_address = copy_address(listener->fallback_address);
+        if (clone->fallback_address == NULL)
+            goto error;
+    }
+
+    if (listener->source_address != NULL) {
+        clone->source_address = copy_address(listener->source_address);
+        if (clone->source_address == NULL)
+            goto error;
+    }
+
+    if (listener->table_name != NULL) {
+        clone->table_name = strdup(listener->table_name);
+        if (clone->table_name == NULL)
+            goto error;
+    }
+
+    clone->protocol = listener->protocol;
+    clone->access_log = logger_ref_get(listener->access_log);
+    clone->log_bad_requests = listener->log_bad_requests;
+    clone->reuseport = listener->reuseport;
+    clone->transparent_proxy = listener->transparent_proxy;
+    clone->ipv6_v6only = listener->ipv6_v6only;
+    clone->incoming_cpu = listener->incoming_cpu;
+    clone->splice = listener->splice;
+    clone->mirrored_buffers = listener->mirrored_buffers;
+    clone->fallback_use_proxy_header = listener->fallback_use_proxy_header;
+    clone->lookup_cache_size = listener->lookup_cache_size;
+    clone->max_buffer_size = listener->max_buffer_size;
+    clone->max_request_size = listener->max_request_size;
+    clone->accept_batch = listener->accept_batch;
+    clone->accept_cb = listener->accept_cb;
+
+    return clone;
+
+error:
+    err("%s: malloc", __func__);
+    free_listener(clone);
+
+    return NULL;
+}
+
 int
 accept_listener_arg(struct Listener *listener, const char *arg) {
     if (listener->address == NULL && !is_numeric(arg)) {
@@ -326,6 +385,115 @@ accept_listener_ipv6_v6only(struct Listener *listener, const char *ipv6_v6only)
     return 1;
 }
 
+int
+accept_listener_splice(struct Listener *listener, const char *splice) {
+    listener->splice = parse_boolean(splice);
+    if (listener->splice == -1) {
+        return 0;
+    }
+
+#ifndef HAVE_SPLICE
+    if (listener->splice == 1) {
+        err("splice not supported in this build");
+        return 0;
+    }
+#endif
+
+    return 1;
+}
+
+int
+accept_listener_mirrored_buffers(struct Listener *listener, const char *mirrored) {
+    listener->mirrored_buffers = parse_boolean(mirrored);
+    if (listener->mirrored_buffers == -1) {
+        return 0;
+    }
+
+#ifndef HAVE_MEMFD_CREATE
+    if (listener->mirrored_buffers == 1) {
+        err("mirrored buffers not supported in this build");
+        return 0;
+    }
+#endif
+
+    return 1;
+}
+
+int
+accept_listener_lookup_cache(struct Listener *listener, const char *size) {
+    if (!is_numeric(size)) {
+        err("Invalid lookup cache size: %s", size);
+        return 0;
+    }
+
+    listener->lookup_cache_size = strtoul(size, NULL, 10);
+
+    return 1;
+}
+
+/*
+ * Connection buffers start at DEFAULT_BUFFER_SIZE bytes and grow in powers of
+ * two up to this size while data is relayed faster than it is consumed
+ */
+int
+accept_listener_max_buffer_size(struct Listener *listener, const char *size) {
+    return accept_buffer_size("Maximum buffer size", size,
+            &listener->max_buffer_size);
+}
+
+/*
+ * The client buffer grows up to this size while the client request is
+ * incomplete, e.g. a TLS client hello spanning several records
+ */
+int
+accept_listener_max_request_size(struct Listener *listener, const char *size) {
+    return accept_buffer_size("Maximum request size", size,
+            &listener->max_request_size);
+}
+
+/*
+ * Number of connections accepted on each readiness event before returning to
+ * the event loop, so connections already established are not starved
+ */
+int
+accept_listener_accept_batch(struct Listener *listener, const char *batch) {
+    if (!is_numeric(batch)) {
+        err("Invalid accept batch: %s", batch);
+        return 0;
+    }
+
+    listener->accept_batch = strtoul(batch, NULL, 10);
+    if (listener->accept_batch < 1 ||
+            listener->accept_batch > MAX_ACCEPT_BATCH) {
+        err("Accept batch must be between 1 and %d: %s",
+                MAX_ACCEPT_BATCH, batch);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int
+accept_buffer_size(const char *description, const char *value, size_t *size) {
+    if (!is_numeric(value)) {
+        err("Invalid %s: %s", description, value);
+        return 0;
+    }
+
+    unsigned long buffer_size = strtoul(value, NULL, 10);
+    if (buffer_size < DEFAULT_BUFFER_SIZE ||
+            buffer_size > 1024 * 1024 * 1024 ||
+            (buffer_size & (buffer_size - 1)) != 0) {
+        err("%s must be a power of two between %d and %d: %s",
+                description, DEFAULT_BUFFER_SIZE, 1024 * 1024 * 1024, value);
+        return 0;
+    }
+
+    *size = buffer_size;
+
+    return 1;
+}
+
 int
 accept_listener_fallback_address(struct Listener *listener, const char *fallback) {
     if (listener->fallback_address == NULL) {
@@ -501,6 +669,9 @@ init_listener(struct Listener *listener, const struct Table_head *tables,
     init_table(table);
     listener->table = table_ref_get(table);
 
+    if (listener->lookup_cache_size > 0 && listener->lookup_cache == NULL)
+        listener->lookup_cache = new_lookup_cache(listener->lookup_cache_size);
+
     /* If no port was specified on the fallback address, inherit the address
      * from the listening address */
     if (listener->fallback_address &&
@@ -551,6 +722,17 @@ init_listener(struct Listener *listener, const struct Table_head *tables,
         }
     }
 
+    if (listener->incoming_cpu >= 0) {
+#ifdef SO_INCOMING_CPU
+        /* prefer this socket for connections whose packets are processed by
+         * the CPU the worker accepting on it is bound to */
+        if (setsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU,
+                    &listener->incoming_cpu,
+                    sizeof(listener->incoming_cpu)) < 0)
+            warn("setsockopt SO_INCOMING_CPU failed: %s", strerror(errno));
+#endif
+    }
+
     if (listener->ipv6_v6only == 1 &&
             address_sa(listener->address)->sa_family == AF_INET6) {
 #ifdef IPV6_V6ONLY
@@ -608,6 +790,77 @@ init_listener(struct Listener *listener, const struct Table_head *tables,
     return sockfd;
 }
 
+/*
+ * Lookup the server address for name and the ALPN protocols offered by the
+ * client, using the listener's lookup cache if enabled. Results for repeated
+ * names are served from the cache until the listener's table is reloaded.
+ */
+struct LookupResult
+listener_lookup_server_address(const struct Listener *listener,
+        const char *name, size_t name_len, const char *alpn, size_t alpn_len) {
+    struct LookupCache *cache = listener->lookup_cache;
+    char key[HOSTNAME_MAX_LEN + 1 + ALPN_MAX_LEN];
+    const char *cache_key = name;
+    size_t cache_key_len = name_len;
+
+    if (cache == NULL || name == NULL)
+        return lookup_server_address(listener, name, name_len, alpn, alpn_len);
+
+    /* The offered protocols only affect the result if the table uses them */
+    if (listener->table->alpn_backends > 0 && alpn_len > 0) {
+        if (name_len > HOSTNAME_MAX_LEN || alpn_len > ALPN_MAX_LEN)
+            return lookup_server_address(listener, name, name_len,
+                    alpn, alpn_len);
+
+        memcpy(key, name, name_len);
+        key[name_len] = '\0';
+        memcpy(key + name_len + 1, alpn, alpn_len);
+        cache_key = key;
+        cache_key_len = name_len + 1 + alpn_len;
+    }
+
+    lookup_cache_validate(cache, listener->table->generation);
+
+    const struct LookupResult *cached =
+        lookup_cache_get(cache, cache_key, cache_key_len);
+    if (cached == NULL) {
+        struct LookupResult result =
+            lookup_server_address(listener, name, name_len, alpn, alpn_len);
+
+        /* On failure the cache has already released result */
+        cached = lookup_cache_put(cache, cache_key, cache_key_len, result);
+        if (cached == NULL)
+            return lookup_server_address(listener, name, name_len,
+                    alpn, alpn_len);
+    }
+
+    return cached_lookup_result(cached);
+}
+
+/*
+ * Socket addresses are copied by the caller immediately, so may be returned
+ * from the cache directly. Hostnames are held for the duration of the DNS
+ * query, during which the cache entry could be evicted, so return a copy.
+ */
+static struct LookupResult
+cached_lookup_result(const struct LookupResult *cached) {
+    if (cached->address == NULL || !address_is_hostname(cached->address))
+        return (struct LookupResult){
+            .address = cached->address,
+            .use_proxy_header = cached->use_proxy_header
+        };
+
+    struct Address *new_addr = copy_address(cached->address);
+    if (new_addr == NULL)
+        err("%s: copy_address", __func__);
+
+    return (struct LookupResult){
+        .address = new_addr,
+        .caller_free_address = 1,
+        .use_proxy_header = cached->use_proxy_header
+    };
+}
+
 /*
  * Allocate a new server address trying:
  *      1. lookup name in table for hostname or socket address
@@ -615,11 +868,12 @@ init_listener(struct Listener *listener, const struct Table_head *tables,
  *         address based on the request hostname (if valid)
  *      3. use the fallback address
  */
-struct LookupResult
-listener_lookup_server_address(const struct Listener *listener,
-        const char *name, size_t name_len) {
+static struct LookupResult
+lookup_server_address(const struct Listener *listener,
+        const char *name, size_t name_len, const char *alpn, size_t alpn_len) {
     struct LookupResult table_result =
-        table_lookup_server_address(listener->table, name, name_len);
+        table_lookup_server_address(listener->table, name, name_len,
+                alpn, alpn_len);
 
     if (table_result.address == NULL) {
         /* No match in table, use fallback address if present */
@@ -710,9 +964,57 @@ print_listener_config(FILE *file, const struct Listener *listener) {
     if (listener->reuseport)
         fprintf(file, "\treuseport on\n");
 
+    if (listener->splice)
+        fprintf(file, "\tsplice on\n");
+
+    if (listener->mirrored_buffers)
+        fprintf(file, "\tmirrored_buffers on\n");
+
+    if (listener->lookup_cache_size != DEFAULT_LOOKUP_CACHE_SIZE)
+        fprintf(file, "\tlookup_cache %zu\n", listener->lookup_cache_size);
+
+    if (listener->max_buffer_size != DEFAULT_MAX_BUFFER_SIZE)
+        fprintf(file, "\tmax_buffer_size %zu\n", listener->max_buffer_size);
+
+    if (listener->max_request_size != DEFAULT_MAX_REQUEST_SIZE)
+        fprintf(file, "\tmax_request_size %zu\n", listener->max_request_size);
+
+    if (listener->accept_batch != DEFAULT_ACCEPT_BATCH)
+        fprintf(file, "\taccept_batch %zu\n", listener->accept_batch);
+
     fprintf(file, "}\n\n");
 }
 
+/*
+ * Print the number of connections accepted by each batch on the listeners
+ */
+void
+print_accept_stats(FILE *file, const struct Listener_head *listeners) {
+    const struct Listener *listener;
+    char address[ADDRESS_BUFFER_SIZE];
+
+    SLIST_FOREACH(listener, listeners, entries) {
+        const struct AcceptStats *stats = &listener->accept_stats;
+
+        fprintf(file, "%s: %zu connections accepted in %zu batches, "
+                "%zu limited by accept_batch %zu\n",
+                display_address(listener->address, address, sizeof(address)),
+                stats->accepted, stats->batches, stats->exhausted,
+                listener->accept_batch);
+
+        for (size_t i = 0; i < ACCEPT_BATCH_BUCKETS; i++) {
+            if (stats->batch_sizes[i] == 0)
+                continue;
+
+            if (i < 2)
+                fprintf(file, "\t%zu: %zu\n", i, stats->batch_sizes[i]);
+            else
+                fprintf(file, "\t%zu-%zu: %zu\n", (size_t)1 << (i - 1),
+                        ((size_t)1 << i) - 1, stats->batch_sizes[i]);
+        }
+    }
+}
+
 static void
 close_listener(struct ev_loop *loop, struct Listener *listener) {
     ev_timer_stop(loop, &listener->backoff_timer);
@@ -737,6 +1039,9 @@ free_listener(struct Listener *listener) {
     table_ref_put(listener->table);
     listener->table = NULL;
 
+    free_lookup_cache(listener->lookup_cache);
+    listener->lookup_cache = NULL;
+
     logger_ref_put(listener->access_log);
     listener->access_log = NULL;
 
@@ -780,12 +1085,25 @@ listener_ref_get(struct Listener *listener) {
     return listener;
 }
 
+/*
+ * Accept connections until the backlog is empty or accept_batch connections
+ * have been accepted
+ */
 static void
 accept_cb(struct ev_loop *loop, struct ev_io *w, int revents) {
     struct Listener *listener = (struct Listener *)w->data;
 
     if (revents & EV_READ) {
-        int result = listener->accept_cb(listener, loop);
+        size_t accepted = 0;
+        int result;
+
+        while ((result = listener->accept_cb(listener, loop)) > 0)
+            if (++accepted == listener->accept_batch)
+                break;
+
+        record_accept_batch(&listener->accept_stats, accepted,
+                accepted == listener->accept_batch);
+
         if (result == 0 && (errno == EMFILE || errno == ENFILE)) {
             char address_buf[ADDRESS_BUFFER_SIZE];
             int backoff_time = 2;
@@ -802,6 +1120,20 @@ accept_cb(struct ev_loop *loop, struct ev_io *w, int revents) {
     }
 }
 
+static void
+record_accept_batch(struct AcceptStats *stats, size_t accepted,
+        int exhausted) {
+    size_t bucket = 0;
+
+    while (accepted >> bucket && bucket < ACCEPT_BATCH_BUCKETS - 1)
+        bucket++;
+
+    stats->batches++;
+    stats->accepted += accepted;
+    stats->exhausted += exhausted;
+    stats->batch_sizes[bucket]++;
+}
+
 static void
 backoff_timer_cb(struct ev_loop *loop, struct ev_timer *w, int revents) {
     struct Listener *listener = (struct Listener *)w->data;
@@ -31,6 +31,14 @@
 #include "address.h"
 #include "table.h"
 
+#define DEFAULT_BUFFER_SIZE 4096
+#define DEFAULT_MAX_BUFFER_SIZE 65536
+#define DEFAULT_MAX_REQUEST_SIZE 16384
+#define DEFAULT_ACCEPT_BATCH 64
+#define MAX_ACCEPT_BATCH 1024
+/* Batch sizes are counted in power of two buckets: 0, 1, 2-3, ... 1024 */
+#define ACCEPT_BATCH_BUCKETS 12
+
 SLIST_HEAD(Listener_head, Listener);
 
 struct Listener {
@@ -40,19 +48,34 @@ struct Listener {
     char *table_name;
     struct Logger *access_log;
     int log_bad_requests, reuseport, transparent_proxy, ipv6_v6only;
+    int incoming_cpu;
+    int splice;
+    int mirrored_buffers;
     int fallback_use_proxy_header;
+    size_t lookup_cache_size;
+    size_t max_buffer_size;
+    size_t max_request_size;
+    size_t accept_batch;
 
     /* Runtime fields */
     int reference_count;
     struct ev_io watcher;
     struct ev_timer backoff_timer;
     struct Table *table;
+    struct LookupCache *lookup_cache;
+    struct AcceptStats {
+        size_t batches;
+        size_t accepted;
+        size_t exhausted; /* batches ending on the accept_batch limit */
+        size_t batch_sizes[ACCEPT_BATCH_BUCKETS];
+    } accept_stats;
     int (*accept_cb)(struct Listener *, struct ev_loop *);
     SLIST_ENTRY(Listener) entries;
 };
 
 
 struct Listener *new_listener();
+struct Listener *clone_listener(const struct Listener *);
 int accept_listener_arg(struct Listener *, const char *);
 int accept_listener_table_name(struct Listener *, const char *);
 int accept_listener_fallback_address(struct Listener *, const char *);
@@ -60,6 +83,12 @@ int accept_listener_source_address(struct Listener *, const char *);
 int accept_listener_protocol(struct Listener *, const char *);
 int accept_listener_reuseport(struct Listener *, const char *);
 int accept_listener_ipv6_v6only(struct Listener *, const char *);
+int accept_listener_splice(struct Listener *, const char *);
+int accept_listener_mirrored_buffers(struct Listener *, const char *);
+int accept_listener_lookup_cache(struct Listener *, const char *);
+int accept_listener_max_buffer_size(struct Listener *, const char *);
+int accept_listener_max_request_size(struct Listener *, const char *);
+int accept_listener_accept_batch(struct Listener *, const char *);
 int accept_listener_bad_request_action(struct Listener *, const char *);
 
 void add_listener(struct Listener_head *, struct Listener *);
@@ -70,8 +99,9 @@ void free_listeners(struct Listener_head *, struct ev_loop *);
 
 int valid_listener(const struct Listener *);
 struct LookupResult listener_lookup_server_address(const struct Listener *,
-        const char *, size_t);
+        const char *, size_t, const char *, size_t);
 void print_listener_config(FILE *, const struct Listener *);
+void print_accept_stats(FILE *, const struct Listener_head *);
 void listener_ref_put(struct Listener *);
 struct Listener *listener_ref_get(struct Listener *);
 
@@ -31,6 +31,7 @@
 #include <syslog.h>
 #include <time.h>
 #include <assert.h>
+#include <pthread.h>
 #include <sys/queue.h>
 #include "logger.h"
 
@@ -57,6 +58,8 @@ struct LogSink {
 
 static struct Logger *default_logger = NULL;
 static SLIST_HEAD(LogSink_head, LogSink) sinks = SLIST_HEAD_INITIALIZER(sinks);
+/* Loggers may be released by any worker thread, serialize access to sinks */
+static pthread_mutex_t sinks_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 static void free_logger(struct Logger *);
@@ -77,7 +80,9 @@ struct Logger *
 new_syslog_logger(const char *facility) {
     struct Logger *logger = malloc(sizeof(struct Logger));
     if (logger != NULL) {
-        logger->sink = obtain_syslog_sink();
+        pthread_mutex_lock(&sinks_lock);
+        logger->sink = log_sink_ref_get(obtain_syslog_sink());
+        pthread_mutex_unlock(&sinks_lock);
         if (logger->sink == NULL) {
             free(logger);
             return NULL;
@@ -85,8 +90,6 @@ new_syslog_logger(const char *facility) {
         logger->priority = LOG_DEBUG;
         logger->facility = lookup_syslog_facility(facility);
         logger->reference_count = 0;
-
-        log_sink_ref_get(logger->sink);
     }
 
     return logger;
@@ -96,7 +99,12 @@ struct Logger *
 new_file_logger(const char *filepath) {
     struct Logger *logger = malloc(sizeof(struct Logger));
     if (logger != NULL) {
-        logger->sink = obtain_file_sink(filepath);
+        /* errors are logged while holding sinks_lock */
+        init_default_logger();
+
+        pthread_mutex_lock(&sinks_lock);
+        logger->sink = log_sink_ref_get(obtain_file_sink(filepath));
+        pthread_mutex_unlock(&sinks_lock);
         if (logger->sink == NULL) {
             free(logger);
             return NULL;
@@ -104,8 +112,6 @@ new_file_logger(const char *filepath) {
         logger->priority = LOG_DEBUG;
         logger->facility = 0;
         logger->reference_count = 0;
-
-        log_sink_ref_get(logger->sink);
     }
 
     return logger;
@@ -115,6 +121,10 @@ void
 reopen_loggers() {
     struct LogSink *sink;
 
+    /* errors are logged while holding sinks_lock */
+    init_default_logger();
+
+    pthread_mutex_lock(&sinks_lock);
     SLIST_FOREACH(sink, &sinks, entries) {
         if (sink->type == LOG_SINK_SYSLOG) {
             closelog();
@@ -128,6 +138,7 @@ reopen_loggers() {
                 setvbuf(sink->fd, NULL, _IOLBF, 0);
         }
     }
+    pthread_mutex_unlock(&sinks_lock);
 }
 
 void
@@ -151,16 +162,17 @@ logger_ref_put(struct Logger *logger) {
     if (logger == NULL)
         return;
 
-    assert(logger->reference_count > 0);
-    logger->reference_count--;
-    if (logger->reference_count == 0)
+    int reference_count =
+        __atomic_sub_fetch(&logger->reference_count, 1, __ATOMIC_ACQ_REL);
+    assert(reference_count >= 0);
+    if (reference_count == 0)
         free_logger(logger);
 }
 
 struct Logger *
 logger_ref_get(struct Logger *logger) {
     if (logger != NULL)
-        logger->reference_count++;
+        __atomic_add_fetch(&logger->reference_count, 1, __ATOMIC_RELAXED);
 
     return logger;
 }
@@ -284,7 +296,9 @@ init_default_logger() {
 
     logger = malloc(sizeof(struct Logger));
     if (logger != NULL) {
-        logger->sink = obtain_stderr_sink();
+        pthread_mutex_lock(&sinks_lock);
+        logger->sink = log_sink_ref_get(obtain_stderr_sink());
+        pthread_mutex_unlock(&sinks_lock);
         if (logger->sink == NULL) {
             free(logger);
             return;
@@ -292,8 +306,6 @@ init_default_logger() {
         logger->priority = LOG_DEBUG;
         logger->facility = 0;
         logger->reference_count = 0;
-
-        log_sink_ref_get(logger->sink);
     }
 
     if (logger == NULL)
@@ -437,10 +449,12 @@ log_sink_ref_put(struct LogSink *sink) {
     if (sink == NULL)
         return;
 
+    pthread_mutex_lock(&sinks_lock);
     assert(sink->reference_count > 0);
     sink->reference_count--;
     if (sink->reference_count == 0)
         free_sink(sink);
+    pthread_mutex_unlock(&sinks_lock);
 }
 
 static void
@@ -475,20 +489,19 @@ static const char *
 timestamp(char *dst, size_t dst_len) {
     /* TODO change to ev_now() */
     time_t now = time(NULL);
-    static struct {
+    static __thread struct {
         time_t when;
         char string[32];
     } timestamp_cache = { .when = 0, .string = {'\0'} };
 
     if (now != timestamp_cache.when) {
+        struct tm tm;
 #ifdef RFC3339_TIMESTAMP
-        struct tm *tmp = gmtime(&now);
         strftime(timestamp_cache.string, sizeof(timestamp_cache.string),
-                "%FT%TZ ", tmp);
+                "%FT%TZ ", gmtime_r(&now, &tm));
 #else
-        struct tm *tmp = localtime(&now);
         strftime(timestamp_cache.string, sizeof(timestamp_cache.string),
-                "%F %T ", tmp);
+                "%F %T ", localtime_r(&now, &tm));
 #endif
 
         timestamp_cache.when = now;
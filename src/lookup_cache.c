@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2026, agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/queue.h>
+#include "lookup_cache.h"
+#include "name_hash.h"
+#include "logger.h"
+
+
+/*
+ * Bounded least recently used cache of lookup results keyed by hostname.
+ *
+ * Entries own their result address if the lookup returned one the caller was
+ * responsible for freeing. The cache records the generation of the table
+ * results were looked up in, and is flushed when that changes.
+ */
+struct LookupCacheEntry {
+    LIST_ENTRY(LookupCacheEntry) hash_entries;
+    TAILQ_ENTRY(LookupCacheEntry) lru_entries;
+    struct LookupResult result;
+    uint32_t hash;
+    size_t name_len;
+    char name[];
+};
+
+LIST_HEAD(LookupCacheBucket, LookupCacheEntry);
+TAILQ_HEAD(LookupCacheLRU, LookupCacheEntry);
+
+struct LookupCache {
+    struct LookupCacheBucket *buckets;
+    size_t mask;        /* number of buckets - 1 */
+    struct LookupCacheLRU lru;
+    size_t len;
+    size_t size;        /* maximum number of entries */
+    unsigned int generation;
+};
+
+
+static struct LookupCacheEntry *find_entry(const struct LookupCache *,
+        uint32_t, const char *, size_t);
+static void remove_entry(struct LookupCache *, struct LookupCacheEntry *);
+
+
+struct LookupCache *
+new_lookup_cache(size_t size) {
+    struct LookupCache *cache = calloc(1, sizeof(struct LookupCache));
+    size_t buckets_len = 8;
+
+    if (cache == NULL) {
+        err("%s: calloc", __func__);
+        return NULL;
+    }
+
+    while (buckets_len < size)
+        buckets_len *= 2;
+
+    cache->buckets = calloc(buckets_len, sizeof(struct LookupCacheBucket));
+    if (cache->buckets == NULL) {
+        err("%s: calloc", __func__);
+        free(cache);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < buckets_len; i++)
+        LIST_INIT(&cache->buckets[i]);
+    TAILQ_INIT(&cache->lru);
+    cache->mask = buckets_len - 1;
+    cache->size = size;
+
+    return cache;
+}
+
+/*
+ * Returns the cached result for name or NULL, the result remains valid until
+ * the next lookup_cache_put(), lookup_cache_validate() or lookup_cache_flush()
+ */
+const struct LookupResult *
+lookup_cache_get(struct LookupCache *cache, const char *name, size_t name_len) {
+    struct LookupCacheEntry *entry =
+        find_entry(cache, hash_name(name, name_len), name, name_len);
+
+    if (entry == NULL)
+        return NULL;
+
+    /* move to the front of the LRU list */
+    if (entry != TAILQ_FIRST(&cache->lru)) {
+        TAILQ_REMOVE(&cache->lru, entry, lru_entries);
+        TAILQ_INSERT_HEAD(&cache->lru, entry, lru_entries);
+    }
+
+    return &entry->result;
+}
+
+/*
+ * Insert result for name, evicting the least recently used entry if the
+ * cache is full. The cache takes ownership of result.address if
+ * result.caller_free_address is set, even if NULL is returned.
+ */
+const struct LookupResult *
+lookup_cache_put(struct LookupCache *cache, const char *name, size_t name_len,
+        struct LookupResult result) {
+    uint32_t hash = hash_name(name, name_len);
+    struct LookupCacheEntry *entry = find_entry(cache, hash, name, name_len);
+
+    if (entry != NULL)
+        remove_entry(cache, entry);
+    else if (cache->len >= cache->size && cache->len > 0)
+        remove_entry(cache, TAILQ_LAST(&cache->lru, LookupCacheLRU));
+
+    if (cache->size == 0 ||
+            (entry = malloc(sizeof(struct LookupCacheEntry) + name_len)) == NULL) {
+        if (result.caller_free_address)
+            free((void *)result.address);
+        return NULL;
+    }
+
+    entry->result = result;
+    entry->hash = hash;
+    entry->name_len = name_len;
+    memcpy(entry->name, name, name_len);
+
+    LIST_INSERT_HEAD(&cache->buckets[hash & cache->mask], entry, hash_entries);
+    TAILQ_INSERT_HEAD(&cache->lru, entry, lru_entries);
+    cache->len++;
+
+    return &entry->result;
+}
+
+/*
+ * Flush the cache if results were looked up in a different table generation
+ */
+void
+lookup_cache_validate(struct LookupCache *cache, unsigned int generation) {
+    if (cache->generation == generation)
+        return;
+
+    lookup_cache_flush(cache);
+    cache->generation = generation;
+}
+
+void
+lookup_cache_flush(struct LookupCache *cache) {
+    struct LookupCacheEntry *entry;
+
+    while ((entry = TAILQ_FIRST(&cache->lru)) != NULL)
+        remove_entry(cache, entry);
+}
+
+size_t
+lookup_cache_size(const struct LookupCache *cache) {
+    return cache->size;
+}
+
+void
+free_lookup_cache(struct LookupCache *cache) {
+    if (cache == NULL)
+        return;
+
+    lookup_cache_flush(cache);
+    free(cache->buckets);
+    free(cache);
+}
+
+static struct LookupCacheEntry *
+find_entry(const struct LookupCache *cache, uint32_t hash,
+        const char *name, size_t name_len) {
+    struct LookupCacheEntry *entry;
+
+    LIST_FOREACH(entry, &cache->buckets[hash & cache->mask], hash_entries)
+        if (entry->hash == hash && entry->name_len == name_len &&
+                memcmp(entry->name, name, name_len) == 0)
+            return entry;
+
+    return NULL;
+}
+
+static void
+remove_entry(struct LookupCache *cache, struct LookupCacheEntry *entry) {
+    LIST_REMOVE(entry, hash_entries);
+    TAILQ_REMOVE(&cache->lru, entry, lru_entries);
+    cache->len--;
+
+    if (entry->result.caller_free_address)
+        free((void *)entry->result.address);
+    free(entry);
+}
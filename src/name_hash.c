@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2026, agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "name_hash.h"
+#include "logger.h"
+
+
+/*
+ * Open addressing hash table with linear probing mapping exact names to the
+ * smallest value inserted with that name. The table is sized when it is built
+ * and never modified afterwards.
+ */
+struct NameHashSlot {
+    const char *name;   /* NULL if slot is empty */
+    size_t name_len;
+    uint32_t hash;
+    size_t value;
+};
+
+struct NameHash {
+    struct NameHashSlot *slots;
+    size_t mask;        /* number of slots - 1 */
+    char *names;        /* storage for all slot names */
+};
+
+
+static struct NameHashSlot *find_slot(const struct NameHash *, uint32_t,
+        const char *, size_t);
+
+
+/* FNV-1a offset basis, replaced by seed_name_hash() */
+static uint32_t hash_seed = 2166136261u;
+
+
+struct NameHash *
+new_name_hash(const struct NameHashEntry *entries, size_t entries_len) {
+    struct NameHash *hash = calloc(1, sizeof(struct NameHash));
+    size_t slots_len = 8;
+    size_t names_len = 0;
+
+    if (hash == NULL) {
+        err("%s: calloc", __func__);
+        return NULL;
+    }
+
+    /* keep load factor at or below 50% */
+    while (slots_len < entries_len * 2)
+        slots_len *= 2;
+
+    for (size_t i = 0; i < entries_len; i++)
+        names_len += entries[i].name_len;
+
+    hash->slots = calloc(slots_len, sizeof(struct NameHashSlot));
+    hash->names = malloc(names_len + 1);
+    if (hash->slots == NULL || hash->names == NULL) {
+        err("%s: malloc", __func__);
+        free_name_hash(hash);
+        return NULL;
+    }
+    hash->mask = slots_len - 1;
+
+    char *name = hash->names;
+    for (size_t i = 0; i < entries_len; i++) {
+        uint32_t h = hash_name(entries[i].name, entries[i].name_len);
+        struct NameHashSlot *slot = find_slot(hash, h,
+                entries[i].name, entries[i].name_len);
+
+        if (slot->name != NULL) {
+            /* duplicate name */
+            if (entries[i].value < slot->value)
+                slot->value = entries[i].value;
+            continue;
+        }
+
+        memcpy(name, entries[i].name, entries[i].name_len);
+        slot->name = name;
+        slot->name_len = entries[i].name_len;
+        slot->hash = h;
+        slot->value = entries[i].value;
+        name += entries[i].name_len;
+    }
+
+    return hash;
+}
+
+/*
+ * Returns the value associated with name or NAME_HASH_NONE
+ */
+size_t
+name_hash_lookup(const struct NameHash *hash, const char *name, size_t name_len) {
+    const struct NameHashSlot *slot =
+        find_slot(hash, hash_name(name, name_len), name, name_len);
+
+    if (slot->name == NULL)
+        return NAME_HASH_NONE;
+
+    return slot->value;
+}
+
+void
+free_name_hash(struct NameHash *hash) {
+    if (hash == NULL)
+        return;
+
+    free(hash->slots);
+    free(hash->names);
+    free(hash);
+}
+
+/*
+ * Find the slot containing name, or the empty slot where it would be inserted
+ */
+static struct NameHashSlot *
+find_slot(const struct NameHash *hash, uint32_t h, const char *name, size_t name_len) {
+    size_t i = h & hash->mask;
+
+    for (;;) {
+        struct NameHashSlot *slot = &hash->slots[i];
+
+        if (slot->name == NULL)
+            return slot;
+
+        if (slot->hash == h && slot->name_len == name_len &&
+                memcmp(slot->name, name, name_len) == 0)
+            return slot;
+
+        i = (i + 1) & hash->mask;
+    }
+}
+
+/*
+ * Seed hash_name() from random data, so clients can not choose hostnames
+ * which collide in the lookup and resolver caches. Must be called before
+ * any names are hashed, worker threads and processes share the seed.
+ */
+void
+seed_name_hash() {
+    uint32_t seed;
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0 || read(fd, &seed, sizeof(seed)) != sizeof(seed)) {
+        warn("Unable to read /dev/urandom, seeding name hash from time");
+        seed = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+    }
+    if (fd >= 0)
+        close(fd);
+
+    hash_seed ^= seed;
+}
+
+/*
+ * FNV-1a from a per process seed, with the MurmurHash3 finalizer so the low
+ * bits used to pick a bucket depend on the whole name
+ */
+uint32_t
+hash_name(const char *name, size_t name_len) {
+    uint32_t h = hash_seed;
+
+    for (size_t i = 0; i < name_len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2026, agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "pool.h"
+
+
+struct FreeObject {
+    struct FreeObject *next;
+};
+
+
+static void release_object(struct Pool *, struct FreeObject *);
+
+
+void *
+pool_alloc(struct Pool *pool) {
+    struct FreeObject *object = pool->free_list;
+
+    if (object != NULL) {
+        pool->free_list = object->next;
+        pool->free_len--;
+        pool->reused++;
+    } else {
+        assert(pool->object_size >= sizeof(struct FreeObject));
+
+        object = pool->alloc != NULL ?
+            pool->alloc(pool->object_size) : malloc(pool->object_size);
+        if (object == NULL)
+            return NULL;
+        pool->allocated++;
+    }
+
+    pool->in_use++;
+    if (pool->in_use > pool->peak_in_use)
+        pool->peak_in_use = pool->in_use;
+
+    return object;
+}
+
+void
+pool_free(struct Pool *pool, void *ptr) {
+    struct FreeObject *object = ptr;
+
+    if (object == NULL)
+        return;
+
+    assert(pool->in_use > 0);
+    pool->in_use--;
+
+    if (pool->free_len >= pool->max_free) {
+        release_object(pool, object);
+        return;
+    }
+
+    object->next = pool->free_list;
+    pool->free_list = object;
+    pool->free_len++;
+}
+
+/*
+ * Return all objects on the free list to the system allocator
+ */
+void
+pool_trim(struct Pool *pool) {
+    struct FreeObject *object;
+
+    while ((object = pool->free_list) != NULL) {
+        pool->free_list = object->next;
+        release_object(pool, object);
+    }
+    pool->free_len = 0;
+}
+
+void
+print_pool_stats(FILE *file, const struct Pool *pool) {
+    fprintf(file, "%-16s %zu bytes\t%zu in use (peak %zu), %zu free, "
+            "%zu allocated, %zu reused\n",
+            pool->name, pool->object_size, pool->in_use, pool->peak_in_use,
+            pool->free_len, pool->allocated, pool->reused);
+}
+
+static void
+release_object(struct Pool *pool, struct FreeObject *object) {
+    if (pool->release != NULL)
+        pool->release(object, pool->object_size);
+    else
+        free(object);
+}
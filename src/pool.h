@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2026, agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * Free list of fixed size objects, up to max_free released objects are kept
+ * for reuse rather than returned to the system allocator, or to release when
+ * one is provided
+ */
+struct Pool {
+    const char *name;
+    size_t object_size;
+    size_t max_free;
+    void *(*alloc)(size_t);             /* defaults to malloc() */
+    void (*release)(void *, size_t);    /* defaults to free() */
+    void *free_list;
+    size_t free_len;        /* objects on the free list */
+    size_t in_use;          /* objects allocated and not yet released */
+    size_t peak_in_use;
+    size_t allocated;       /* objects obtained from the system allocator */
+    size_t reused;          /* objects taken from the free list */
+};
+
+#define POOL_INITIALIZER(name, object_size, max_free) \
+    POOL_INITIALIZER_ALLOC(name, object_size, max_free, NULL, NULL)
+#define POOL_INITIALIZER_ALLOC(name, object_size, max_free, alloc, release) \
+    { (name), (object_size), (max_free), (alloc), (release), \
+        NULL, 0, 0, 0, 0, 0 }
+
+void *pool_alloc(struct Pool *);
+void pool_free(struct Pool *, void *);
+void pool_trim(struct Pool *);
+void print_pool_stats(FILE *, const struct Pool *);
+
+#endif
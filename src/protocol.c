@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2026, agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "protocol.h"
+
+
+/*
+ * Copy a hostname of len bytes from a client request to dst, which must hold
+ * at least HOSTNAME_MAX_LEN + 1 bytes. The hostname is converted to lowercase
+ * so lookups need not consider case.
+ *
+ * Returns len, or -5 if the hostname is too long
+ */
+int
+copy_hostname(char *dst, const char *src, size_t len) {
+    if (len > HOSTNAME_MAX_LEN)
+        return -5;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = src[i];
+
+        dst[i] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
+    dst[len] = '\0';
+
+    return (int)len;
+}
+
+/*
+ * Parse a complete request with a protocol's resume_parse(), returning the
+ * hostname in a newly allocated string the caller is responsible for freeing
+ */
+int
+parse_packet_copy(int (*resume_parse)(const char *, size_t, char *,
+            struct ParseState *),
+        const char *data, size_t data_len, char **hostname) {
+    struct ParseState state = { .offset = 0, .need = 0 };
+    char name[HOSTNAME_MAX_LEN + 1];
+
+    if (hostname == NULL)
+        return -3;
+
+    int result = resume_parse(data, data_len, name, &state);
+    if (result < 0)
+        return result;
+
+    *hostname = malloc((size_t)result + 1);
+    if (*hostname == NULL)
+        return -4;
+
+    memcpy(*hostname, name, (size_t)result + 1);
+
+    return result;
+}
@@ -26,14 +26,42 @@
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
 
+#include <stddef.h>
 #include <inttypes.h>
 
+#define HOSTNAME_MAX_LEN 255
+#define ALPN_MAX_LEN 256
+
+/*
+ * Progress parsing an incomplete request, kept between reads so parsing
+ * resumes where it stopped rather than examining the whole request again.
+ * Must be zeroed before the first call.
+ */
+struct ParseState {
+    size_t offset;      /* data before offset has already been examined */
+    size_t need;        /* length of data required to make progress */
+    /* ALPN protocols offered by the client, each preceded by a length byte */
+    char alpn[ALPN_MAX_LEN];
+    size_t alpn_len;
+};
+
+/*
+ * parse_packet() returns the requested hostname in a newly allocated string.
+ * resume_parse() continues parsing a request which was incomplete on a
+ * previous call and copies the hostname, in lowercase, to a caller provided
+ * buffer of HOSTNAME_MAX_LEN + 1 bytes.
+ */
 struct Protocol {
     const char *const name;
     const uint16_t default_port;
     int (*const parse_packet)(const char*, size_t, char **);
+    int (*const resume_parse)(const char*, size_t, char *, struct ParseState *);
     const char *const abort_message;
     const size_t abort_message_len;
 };
 
+int copy_hostname(char *, const char *, size_t);
+int parse_packet_copy(int (*)(const char *, size_t, char *, struct ParseState *),
+        const char *, size_t, char **);
+
 #endif
@@ -26,16 +26,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <ev.h>
 #include <errno.h>
+#include <stdint.h>
+#include <sys/queue.h>
 #ifdef HAVE_LIBUDNS
 #include <udns.h>
 #endif
 #include "resolv.h"
+#include "resolv_cache.h"
+#include "name_hash.h"
 #include "address.h"
 #include "logger.h"
 
@@ -47,7 +52,9 @@
 
 int
 resolv_init(struct ev_loop *loop, char **nameservers, char **search_domains,
-        int mode) {
+        int mode, struct ResolvCache *cache) {
+    free_resolv_cache(cache);
+
     return 0;
 }
 
@@ -71,20 +78,50 @@ resolv_cancel(struct ResolvQuery *query_handle) {
  * Implement DNS resolution interface using libudns
  */
 
-struct ResolvQuery {
-    void (*client_cb)(struct Address *, void *);
-    void (*client_free_cb)(void *);
-    void *client_cb_data;
+/*
+ * A pair of A and AAAA queries in flight for a hostname, shared by every
+ * client waiting on the result
+ */
+struct ResolvRequest {
+    LIST_ENTRY(ResolvRequest) entries;
+    TAILQ_HEAD(, ResolvQuery) waiters;
+    uint32_t hash;
     int resolv_mode;
+    int refresh;        /* refreshing a stale cache entry */
     struct dns_query *queries[2];
     size_t response_count;
     struct Address **responses;
+    unsigned int response_ttl;
+    char hostname[];
+};
+
+/*
+ * Handle returned to a client, either waiting on a request or holding an
+ * answer from the cache to be delivered on the next loop iteration
+ */
+struct ResolvQuery {
+    void (*client_cb)(struct Address *, void *);
+    void (*client_free_cb)(void *);
+    void *client_cb_data;
+    struct ResolvRequest *request;
+    TAILQ_ENTRY(ResolvQuery) entries;
+    struct Address *cached_response;
+    struct ev_timer cached_response_watcher;
 };
 
+LIST_HEAD(ResolvRequestBucket, ResolvRequest);
 
-static int default_resolv_mode = 1 /* RESOLV_MODE_IPV4_ONLY */;
-static struct ev_io resolv_io_watcher;
-static struct ev_timer resolv_timeout_watcher;
+#define REQUEST_BUCKETS 256
+
+
+/* Each worker thread has its own resolver context, socket and cache */
+static __thread int default_resolv_mode = 1 /* RESOLV_MODE_IPV4_ONLY */;
+static __thread struct ev_io resolv_io_watcher;
+static __thread struct ev_timer resolv_timeout_watcher;
+static __thread struct ev_loop *resolv_loop = NULL;
+static __thread struct ResolvCache *resolv_cache = NULL;
+static __thread struct ResolvRequestBucket requests[REQUEST_BUCKETS];
+static int default_ctx_in_use = 0;
 
 
 static void resolv_sock_cb(struct ev_loop *, struct ev_io *, int);
@@ -92,16 +129,38 @@ static void resolv_timeout_cb(struct ev_loop *, struct ev_timer *, int);
 static void dns_query_v4_cb(struct dns_ctx *, struct dns_rr_a4 *, void *);
 static void dns_query_v6_cb(struct dns_ctx *, struct dns_rr_a6 *, void *);
 static void dns_timer_setup_cb(struct dns_ctx *, int, void *);
-static void process_client_callback(struct ResolvQuery *);
-static inline int all_queries_are_null(struct ResolvQuery *);
-static struct Address *choose_ipv4_first(struct ResolvQuery *);
-static struct Address *choose_ipv6_first(struct ResolvQuery *);
-static struct Address *choose_any(struct ResolvQuery *);
+static void cached_response_cb(struct ev_loop *, struct ev_timer *, int);
+static int query_cached_response(struct ResolvQuery *, const char *, int);
+static struct ResolvRequest *find_request(const char *, int);
+static struct ResolvRequest *submit_request(const char *, int);
+static void cancel_request(struct ResolvRequest *);
+static void cache_responses(struct ResolvRequest *);
+static void process_client_callbacks(struct ResolvRequest *);
+static void free_resolv_request(struct ResolvRequest *);
+static void free_resolv_query(struct ResolvQuery *);
+static uint32_t request_hash(const char *, int);
+static inline int all_queries_are_null(struct ResolvRequest *);
+static struct Address *choose_address(int, struct Address *const *, size_t);
+static struct Address *choose_ipv4_first(struct Address *const *, size_t);
+static struct Address *choose_ipv6_first(struct Address *const *, size_t);
+static struct Address *choose_any(struct Address *const *, size_t);
 
 
+/*
+ * Initialize the resolver, takes ownership of cache which may be NULL to
+ * disable caching of query results. The first call uses the default udns
+ * context, later calls from other worker threads each create their own.
+ */
 int
-resolv_init(struct ev_loop *loop, char **nameservers, char **search, int mode) {
+resolv_init(struct ev_loop *loop, char **nameservers, char **search, int mode,
+        struct ResolvCache *cache) {
     struct dns_ctx *ctx = &dns_defctx;
+    if (__atomic_exchange_n(&default_ctx_in_use, 1, __ATOMIC_ACQ_REL)) {
+        ctx = dns_new(NULL);
+        if (ctx == NULL)
+            fatal("Failed to allocate DNS resolver context");
+    }
+
     if (nameservers == NULL) {
         /* Nameservers not specified, use system resolver config */
         dns_init(ctx, 0);
@@ -117,6 +176,11 @@ resolv_init(struct ev_loop *loop, char **nameservers, char **search, int mode) {
     }
 
     default_resolv_mode = mode;
+    resolv_loop = loop;
+    resolv_cache = cache;
+
+    for (size_t i = 0; i < REQUEST_BUCKETS; i++)
+        LIST_INIT(&requests[i]);
 
     int sockfd = dns_open(ctx);
     if (sockfd < 0)
@@ -144,23 +208,39 @@ void
 resolv_shutdown(struct ev_loop * loop) {
     struct dns_ctx *ctx = (struct dns_ctx *)resolv_io_watcher.data;
 
+    /* Cancel background refreshes, which have no client to cancel them */
+    for (size_t i = 0; i < REQUEST_BUCKETS; i++) {
+        struct ResolvRequest *request = LIST_FIRST(&requests[i]);
+        while (request != NULL) {
+            struct ResolvRequest *next = LIST_NEXT(request, entries);
+            if (TAILQ_EMPTY(&request->waiters))
+                cancel_request(request);
+            request = next;
+        }
+    }
+
     ev_io_stop(loop, &resolv_io_watcher);
 
     if (ev_is_active(&resolv_timeout_watcher))
         ev_timer_stop(loop, &resolv_timeout_watcher);
 
-    dns_close(ctx);
+    if (ctx == &dns_defctx) {
+        dns_close(ctx);
+        __atomic_store_n(&default_ctx_in_use, 0, __ATOMIC_RELEASE);
+    } else {
+        dns_free(ctx);
+    }
+
+    free_resolv_cache(resolv_cache);
+    resolv_cache = NULL;
 }
 
 struct ResolvQuery *
 resolv_query(const char *hostname, int mode,
         void (*client_cb)(struct Address *, void *),
         void (*client_free_cb)(void *), void *client_cb_data) {
-    struct dns_ctx *ctx = (struct dns_ctx *)resolv_io_watcher.data;
+    int resolv_mode = mode != RESOLV_MODE_DEFAULT ? mode : default_resolv_mode;
 
-    /*
-     * Wrap udns's call back in our own
-     */
     struct ResolvQuery *cb_data = malloc(sizeof(struct ResolvQuery));
     if (cb_data == NULL) {
         err("Failed to allocate memory for DNS query callback data.");
@@ -169,56 +249,50 @@ resolv_query(const char *hostname, int mode,
     cb_data->client_cb = client_cb;
     cb_data->client_free_cb = client_free_cb;
     cb_data->client_cb_data = client_cb_data;
-    cb_data->resolv_mode = mode != RESOLV_MODE_DEFAULT ?
-                           mode : default_resolv_mode;
-    memset(cb_data->queries, 0, sizeof(cb_data->queries));
-    cb_data->response_count = 0;
-    cb_data->responses = NULL;
-
-    /* Submit A and AAAA queries */
-    if (cb_data->resolv_mode != RESOLV_MODE_IPV6_ONLY) {
-        cb_data->queries[0] = dns_submit_a4(ctx,
-                hostname, 0,
-                dns_query_v4_cb, cb_data);
-        if (cb_data->queries[0] == NULL)
-            err("Failed to submit DNS query: %s", dns_strerror(dns_status(ctx)));
-    };
-
-    if (cb_data->resolv_mode != RESOLV_MODE_IPV4_ONLY) {
-        cb_data->queries[1] = dns_submit_a6(ctx,
-                hostname, 0,
-                dns_query_v6_cb, cb_data);
-        if (cb_data->queries[1] == NULL)
-            err("Failed to submit DNS query: %s", dns_strerror(dns_status(ctx)));
+    cb_data->request = NULL;
+    cb_data->cached_response = NULL;
+    ev_timer_init(&cb_data->cached_response_watcher, cached_response_cb,
+            0.0, 0.0);
+    cb_data->cached_response_watcher.data = cb_data;
+
+    if (query_cached_response(cb_data, hostname, resolv_mode))
+        return cb_data;
+
+    /* Wait on the request already in flight for this hostname if any */
+    struct ResolvRequest *request = find_request(hostname, resolv_mode);
+    if (request == NULL)
+        request = submit_request(hostname, resolv_mode);
+    if (request == NULL) {
+        free_resolv_query(cb_data);
+        return NULL;
     }
 
-    if (all_queries_are_null(cb_data)) {
-        if (cb_data->client_free_cb != NULL)
-            cb_data->client_free_cb(cb_data->client_cb_data);
-        free(cb_data);
-        cb_data = NULL;
-    }
+    cb_data->request = request;
+    TAILQ_INSERT_TAIL(&request->waiters, cb_data, entries);
 
     return cb_data;
 }
 
+/*
+ * Detach a client from its query, the DNS queries are only cancelled once no
+ * other clients are waiting on them
+ */
 void
 resolv_cancel(struct ResolvQuery *query_handle) {
     struct ResolvQuery *cb_data = (struct ResolvQuery *)query_handle;
-    struct dns_ctx *ctx = (struct dns_ctx *)resolv_io_watcher.data;
+    struct ResolvRequest *request = cb_data->request;
 
-    for (size_t i = 0; i < sizeof(cb_data->queries) / sizeof(cb_data->queries[0]); i++) {
-        if (cb_data->queries[i] != NULL) {
-            dns_cancel(ctx, cb_data->queries[i]);
-            free(cb_data->queries[i]);
-            cb_data->queries[i] = NULL;
-        }
+    if (request != NULL) {
+        TAILQ_REMOVE(&request->waiters, cb_data, entries);
+
+        if (TAILQ_EMPTY(&request->waiters) && !all_queries_are_null(request))
+            cancel_request(request);
     }
 
-    if (cb_data->client_free_cb != NULL)
-        cb_data->client_free_cb(cb_data->client_cb_data);
+    if (ev_is_active(&cb_data->cached_response_watcher))
+        ev_timer_stop(resolv_loop, &cb_data->cached_response_watcher);
 
-    free(cb_data);
+    free_resolv_query(cb_data);
 }
 
 /*
@@ -237,18 +311,20 @@ resolv_sock_cb(struct ev_loop *loop, struct ev_io *w, int revents) {
  */
 static void
 dns_query_v4_cb(struct dns_ctx *ctx, struct dns_rr_a4 *result, void *data) {
-    struct ResolvQuery *cb_data = (struct ResolvQuery *)data;
+    struct ResolvRequest *request = (struct ResolvRequest *)data;
 
     if (result == NULL) {
         info("resolv: %s\n", dns_strerror(dns_status(ctx)));
     } else if (result->dnsa4_nrr > 0) {
-        struct Address **new_responses = realloc(cb_data->responses,
-                (cb_data->response_count + (size_t)result->dnsa4_nrr) *
+        struct Address **new_responses = realloc(request->responses,
+                (request->response_count + (size_t)result->dnsa4_nrr) *
                     sizeof(struct Address *));
         if (new_responses == NULL) {
             err("Failed to allocate memory for additional DNS responses");
         } else {
-            cb_data->responses = new_responses;
+            request->responses = new_responses;
+            if (result->dnsa4_ttl < request->response_ttl)
+                request->response_ttl = result->dnsa4_ttl;
 
             for (int i = 0; i < result->dnsa4_nrr; i++) {
                 struct sockaddr_in sa = {
@@ -257,38 +333,40 @@ dns_query_v4_cb(struct dns_ctx *ctx, struct dns_rr_a4 *result, void *data) {
                     .sin_addr = result->dnsa4_addr[i],
                 };
 
-                cb_data->responses[cb_data->response_count] =
+                request->responses[request->response_count] =
                         new_address_sa((struct sockaddr *)&sa, sizeof(sa));
-                if (cb_data->responses[cb_data->response_count] == NULL)
+                if (request->responses[request->response_count] == NULL)
                     err("Failed to allocate memory for DNS query result address");
                 else
-                    cb_data->response_count++;
+                    request->response_count++;
             }
         }
     }
 
     free(result);
-    cb_data->queries[0] = NULL; /* mark A query as being completed */
+    request->queries[0] = NULL; /* mark A query as being completed */
 
-    /* Once all queries have completed, call client callback */
-    if (all_queries_are_null(cb_data))
-        process_client_callback(cb_data);
+    /* Once all queries have completed, call client callbacks */
+    if (all_queries_are_null(request))
+        process_client_callbacks(request);
 }
 
 static void
 dns_query_v6_cb(struct dns_ctx *ctx, struct dns_rr_a6 *result, void *data) {
-    struct ResolvQuery *cb_data = (struct ResolvQuery *)data;
+    struct ResolvRequest *request = (struct ResolvRequest *)data;
 
     if (result == NULL) {
         info("resolv: %s\n", dns_strerror(dns_status(ctx)));
     } else if (result->dnsa6_nrr > 0) {
-        struct Address **new_responses = realloc(cb_data->responses,
-                (cb_data->response_count + (size_t)result->dnsa6_nrr) *
+        struct Address **new_responses = realloc(request->responses,
+                (request->response_count + (size_t)result->dnsa6_nrr) *
                     sizeof(struct Address *));
         if (new_responses == NULL) {
             err("Failed to allocate memory for additional DNS responses");
         } else {
-            cb_data->responses = new_responses;
+            request->responses = new_responses;
+            if (result->dnsa6_ttl < request->response_ttl)
+                request->response_ttl = result->dnsa6_ttl;
 
             for (int i = 0; i < result->dnsa6_nrr; i++) {
                 struct sockaddr_in6 sa = {
@@ -297,73 +375,257 @@ dns_query_v6_cb(struct dns_ctx *ctx, struct dns_rr_a6 *result, void *data) {
                     .sin6_addr = result->dnsa6_addr[i],
                 };
 
-                cb_data->responses[cb_data->response_count] =
+                request->responses[request->response_count] =
                         new_address_sa((struct sockaddr *)&sa, sizeof(sa));
-                if (cb_data->responses[cb_data->response_count] == NULL)
+                if (request->responses[request->response_count] == NULL)
                     err("Failed to allocate memory for DNS query result address");
                 else
-                    cb_data->response_count++;
+                    request->response_count++;
             }
         }
     }
 
     free(result);
-    cb_data->queries[1] = NULL; /* mark AAAA query as being completed */
+    request->queries[1] = NULL; /* mark AAAA query as being completed */
 
-    /* Once all queries have completed, call client callback */
-    if (all_queries_are_null(cb_data))
-        process_client_callback(cb_data);
+    /* Once all queries have completed, call client callbacks */
+    if (all_queries_are_null(request))
+        process_client_callbacks(request);
 }
 
 /*
- * Called once all queries have been completed
+ * Answer query from the cache if possible, the client callback is deferred to
+ * the next event loop iteration since clients expect it to be called after
+ * resolv_query() has returned. Stale answers are used while the entry is
+ * refreshed in the background.
  */
+static int
+query_cached_response(struct ResolvQuery *cb_data, const char *hostname,
+        int resolv_mode) {
+    struct Address *const *cached_responses;
+    size_t cached_response_count;
+
+    if (resolv_cache == NULL)
+        return 0;
+
+    enum ResolvCacheStatus status = resolv_cache_get(resolv_cache,
+            hostname, resolv_mode, ev_now(resolv_loop),
+            &cached_responses, &cached_response_count);
+    if (status == RESOLV_CACHE_MISS)
+        return 0;
+
+    struct Address *best_address = choose_address(resolv_mode,
+            cached_responses, cached_response_count);
+    if (best_address != NULL) {
+        cb_data->cached_response = copy_address(best_address);
+        if (cb_data->cached_response == NULL) {
+            err("Failed to allocate memory for cached DNS response");
+            return 0;
+        }
+    }
+
+    if (status == RESOLV_CACHE_STALE &&
+            find_request(hostname, resolv_mode) == NULL) {
+        struct ResolvRequest *request = submit_request(hostname, resolv_mode);
+        if (request != NULL)
+            request->refresh = 1;
+    }
+
+    ev_timer_start(resolv_loop, &cb_data->cached_response_watcher);
+
+    return 1;
+}
+
 static void
-process_client_callback(struct ResolvQuery *cb_data) {
-    struct Address *best_address = NULL;
+cached_response_cb(struct ev_loop *loop __attribute__((unused)),
+        struct ev_timer *w, int revents) {
+    struct ResolvQuery *cb_data = (struct ResolvQuery *)w->data;
 
-    if (cb_data->resolv_mode == RESOLV_MODE_IPV4_FIRST)
-        best_address = choose_ipv4_first(cb_data);
-    else if (cb_data->resolv_mode == RESOLV_MODE_IPV6_FIRST)
-        best_address = choose_ipv6_first(cb_data);
-    else
-        best_address = choose_any(cb_data);
+    if (revents & EV_TIMER) {
+        cb_data->client_cb(cb_data->cached_response, cb_data->client_cb_data);
+        free_resolv_query(cb_data);
+    }
+}
+
+static struct ResolvRequest *
+find_request(const char *hostname, int resolv_mode) {
+    uint32_t hash = request_hash(hostname, resolv_mode);
+    struct ResolvRequest *request;
 
-    cb_data->client_cb(best_address, cb_data->client_cb_data);
+    LIST_FOREACH(request, &requests[hash % REQUEST_BUCKETS], entries)
+        if (request->hash == hash && request->resolv_mode == resolv_mode &&
+                strcmp(request->hostname, hostname) == 0)
+            return request;
 
-    for (size_t i = 0; i < cb_data->response_count; i++)
-        free(cb_data->responses[i]);
+    return NULL;
+}
+
+/*
+ * Submit A and AAAA queries as required by resolv_mode and add the request
+ * to the in flight table
+ */
+static struct ResolvRequest *
+submit_request(const char *hostname, int resolv_mode) {
+    struct dns_ctx *ctx = (struct dns_ctx *)resolv_io_watcher.data;
+    size_t hostname_len = strlen(hostname);
 
-    free(cb_data->responses);
+    struct ResolvRequest *request =
+        malloc(sizeof(struct ResolvRequest) + hostname_len + 1);
+    if (request == NULL) {
+        err("Failed to allocate memory for DNS request.");
+        return NULL;
+    }
+    TAILQ_INIT(&request->waiters);
+    request->hash = request_hash(hostname, resolv_mode);
+    request->resolv_mode = resolv_mode;
+    request->refresh = 0;
+    memset(request->queries, 0, sizeof(request->queries));
+    request->response_count = 0;
+    request->responses = NULL;
+    request->response_ttl = UINT_MAX;
+    memcpy(request->hostname, hostname, hostname_len + 1);
+
+    if (resolv_mode != RESOLV_MODE_IPV6_ONLY) {
+        request->queries[0] = dns_submit_a4(ctx,
+                hostname, 0,
+                dns_query_v4_cb, request);
+        if (request->queries[0] == NULL)
+            err("Failed to submit DNS query: %s", dns_strerror(dns_status(ctx)));
+    };
+
+    if (resolv_mode != RESOLV_MODE_IPV4_ONLY) {
+        request->queries[1] = dns_submit_a6(ctx,
+                hostname, 0,
+                dns_query_v6_cb, request);
+        if (request->queries[1] == NULL)
+            err("Failed to submit DNS query: %s", dns_strerror(dns_status(ctx)));
+    }
+
+    if (all_queries_are_null(request)) {
+        free_resolv_request(request);
+        return NULL;
+    }
+
+    LIST_INSERT_HEAD(&requests[request->hash % REQUEST_BUCKETS], request,
+            entries);
+
+    return request;
+}
+
+static void
+cancel_request(struct ResolvRequest *request) {
+    struct dns_ctx *ctx = (struct dns_ctx *)resolv_io_watcher.data;
+
+    for (size_t i = 0; i < sizeof(request->queries) / sizeof(request->queries[0]); i++) {
+        if (request->queries[i] != NULL) {
+            dns_cancel(ctx, request->queries[i]);
+            free(request->queries[i]);
+            request->queries[i] = NULL;
+        }
+    }
+
+    LIST_REMOVE(request, entries);
+    free_resolv_request(request);
+}
+
+/*
+ * Store the responses to a completed request in the cache, a failed refresh
+ * leaves the stale entry in place to be used until its stale TTL runs out
+ */
+static void
+cache_responses(struct ResolvRequest *request) {
+    if (resolv_cache == NULL ||
+            (request->refresh && request->response_count == 0))
+        return;
+
+    resolv_cache_put(resolv_cache, request->hostname, request->resolv_mode,
+            request->responses, request->response_count,
+            request->response_ttl, ev_now(resolv_loop));
+}
+
+/*
+ * Called once all queries of a request have been completed, the request is
+ * removed from the in flight table first so clients resolving the same
+ * hostname from their callback start a new request.
+ */
+static void
+process_client_callbacks(struct ResolvRequest *request) {
+    struct Address *best_address = choose_address(request->resolv_mode,
+            request->responses, request->response_count);
+    struct ResolvQuery *cb_data;
+
+    LIST_REMOVE(request, entries);
+    cache_responses(request);
+
+    while ((cb_data = TAILQ_FIRST(&request->waiters)) != NULL) {
+        TAILQ_REMOVE(&request->waiters, cb_data, entries);
+        cb_data->request = NULL;
+
+        cb_data->client_cb(best_address, cb_data->client_cb_data);
+
+        free_resolv_query(cb_data);
+    }
+
+    free_resolv_request(request);
+}
+
+static void
+free_resolv_request(struct ResolvRequest *request) {
+    for (size_t i = 0; i < request->response_count; i++)
+        free(request->responses[i]);
+
+    free(request->responses);
+    free(request);
+}
+
+static void
+free_resolv_query(struct ResolvQuery *cb_data) {
+    free(cb_data->cached_response);
     if (cb_data->client_free_cb != NULL)
         cb_data->client_free_cb(cb_data->client_cb_data);
     free(cb_data);
 }
 
+static uint32_t
+request_hash(const char *hostname, int resolv_mode) {
+    return hash_name(hostname, strlen(hostname)) ^ (uint32_t)resolv_mode;
+}
+
+static struct Address *
+choose_address(int resolv_mode, struct Address *const *responses,
+        size_t response_count) {
+    if (resolv_mode == RESOLV_MODE_IPV4_FIRST)
+        return choose_ipv4_first(responses, response_count);
+    else if (resolv_mode == RESOLV_MODE_IPV6_FIRST)
+        return choose_ipv6_first(responses, response_count);
+    else
+        return choose_any(responses, response_count);
+}
+
 static struct Address *
-choose_ipv4_first(struct ResolvQuery *cb_data) {
-    for (size_t i = 0; i < cb_data->response_count; i++)
-        if (address_is_sockaddr(cb_data->responses[i]) &&
-                address_sa(cb_data->responses[i])->sa_family == AF_INET)
-            return cb_data->responses[i];
+choose_ipv4_first(struct Address *const *responses, size_t response_count) {
+    for (size_t i = 0; i < response_count; i++)
+        if (address_is_sockaddr(responses[i]) &&
+                address_sa(responses[i])->sa_family == AF_INET)
+            return responses[i];
 
-    return choose_any(cb_data);;
+    return choose_any(responses, response_count);
 }
 
 static struct Address *
-choose_ipv6_first(struct ResolvQuery *cb_data) {
-    for (size_t i = 0; i < cb_data->response_count; i++)
-        if (address_is_sockaddr(cb_data->responses[i]) &&
-                address_sa(cb_data->responses[i])->sa_family == AF_INET6)
-            return cb_data->responses[i];
+choose_ipv6_first(struct Address *const *responses, size_t response_count) {
+    for (size_t i = 0; i < response_count; i++)
+        if (address_is_sockaddr(responses[i]) &&
+                address_sa(responses[i])->sa_family == AF_INET6)
+            return responses[i];
 
-    return choose_any(cb_data);;
+    return choose_any(responses, response_count);
 }
 
 static struct Address *
-choose_any(struct ResolvQuery *cb_data) {
-    if (cb_data->response_count >= 1)
-        return cb_data->responses[0];
+choose_any(struct Address *const *responses, size_t response_count) {
+    if (response_count >= 1)
+        return responses[0];
 
     return NULL;
 }
@@ -396,11 +658,11 @@ dns_timer_setup_cb(struct dns_ctx *ctx, int timeout, void *data) {
 }
 
 static inline int
-all_queries_are_null(struct ResolvQuery *cb_data) {
+all_queries_are_null(struct ResolvRequest *request) {
     int result = 1;
 
-    for (size_t i = 0; i < sizeof(cb_data->queries) / sizeof(cb_data->queries[0]); i++)
-        result = result && cb_data->queries[i] == NULL;
+    for (size_t i = 0; i < sizeof(request->queries) / sizeof(request->queries[0]); i++)
+        result = result && request->queries[i] == NULL;
 
     return result;
 }
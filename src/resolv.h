@@ -29,8 +29,9 @@
 #include "address.h"
 
 struct ResolvQuery;
+struct ResolvCache;
 
-int resolv_init(struct ev_loop *, char **, char **, int);
+int resolv_init(struct ev_loop *, char **, char **, int, struct ResolvCache *);
 struct ResolvQuery *resolv_query(const char *, int,
         void(*)(struct Address *, void *), void (*)(void *), void *);
 void resolv_cancel(struct ResolvQuery *);
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2026, agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/queue.h>
+#include "resolv_cache.h"
+#include "name_hash.h"
+#include "logger.h"
+
+
+/*
+ * Bounded least recently used cache of DNS query results keyed by hostname
+ * and resolver mode.
+ *
+ * Each entry holds its own copy of every address returned, so the chosen
+ * address can be picked again according to the mode on each hit. Entries
+ * expire after the smallest TTL of the records they were built from, clamped
+ * to the configured minimum and maximum. Failed queries are cached without
+ * any addresses for the negative TTL.
+ *
+ * Expired entries with addresses are kept for a further stale TTL, during
+ * which they are returned as stale so the caller may use them while it
+ * refreshes the entry.
+ */
+struct ResolvCacheEntry {
+    LIST_ENTRY(ResolvCacheEntry) hash_entries;
+    TAILQ_ENTRY(ResolvCacheEntry) lru_entries;
+    ev_tstamp expires;
+    struct Address **addresses;
+    size_t address_count;
+    uint32_t hash;
+    int mode;
+    size_t hostname_len;
+    char hostname[];
+};
+
+LIST_HEAD(ResolvCacheBucket, ResolvCacheEntry);
+TAILQ_HEAD(ResolvCacheLRU, ResolvCacheEntry);
+
+struct ResolvCache {
+    struct ResolvCacheBucket *buckets;
+    size_t mask;        /* number of buckets - 1 */
+    struct ResolvCacheLRU lru;
+    size_t len;
+    size_t size;        /* maximum number of entries */
+    unsigned int min_ttl;
+    unsigned int max_ttl;
+    unsigned int negative_ttl;
+    unsigned int stale_ttl;
+};
+
+
+static uint32_t hash_key(const char *, size_t, int);
+static struct ResolvCacheEntry *find_entry(const struct ResolvCache *,
+        uint32_t, const char *, size_t, int);
+static void remove_entry(struct ResolvCache *, struct ResolvCacheEntry *);
+
+
+struct ResolvCache *
+new_resolv_cache(size_t size, unsigned int min_ttl, unsigned int max_ttl,
+        unsigned int negative_ttl, unsigned int stale_ttl) {
+    struct ResolvCache *cache = calloc(1, sizeof(struct ResolvCache));
+    size_t buckets_len = 8;
+
+    if (cache == NULL) {
+        err("%s: calloc", __func__);
+        return NULL;
+    }
+
+    while (buckets_len < size)
+        buckets_len *= 2;
+
+    cache->buckets = calloc(buckets_len, sizeof(struct ResolvCacheBucket));
+    if (cache->buckets == NULL) {
+        err("%s: calloc", __func__);
+        free(cache);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < buckets_len; i++)
+        LIST_INIT(&cache->buckets[i]);
+    TAILQ_INIT(&cache->lru);
+    cache->mask = buckets_len - 1;
+    cache->size = size;
+    cache->min_ttl = min_ttl;
+    cache->max_ttl = max_ttl < min_ttl ? min_ttl : max_ttl;
+    cache->negative_ttl = negative_ttl;
+    cache->stale_ttl = stale_ttl;
+
+    return cache;
+}
+
+/*
+ * Look up the addresses cached for hostname in mode, setting addresses and
+ * count unless RESOLV_CACHE_MISS is returned. A count of zero is a cached
+ * failure. Entries past their stale TTL are removed. The addresses remain
+ * valid until the next call to resolv_cache_get(), resolv_cache_put() or
+ * resolv_cache_flush().
+ */
+enum ResolvCacheStatus
+resolv_cache_get(struct ResolvCache *cache, const char *hostname, int mode,
+        ev_tstamp now, struct Address *const **addresses, size_t *count) {
+    size_t hostname_len = strlen(hostname);
+    struct ResolvCacheEntry *entry = find_entry(cache,
+            hash_key(hostname, hostname_len, mode),
+            hostname, hostname_len, mode);
+
+    if (entry == NULL)
+        return RESOLV_CACHE_MISS;
+
+    int stale = entry->expires <= now;
+    if (stale && (entry->address_count == 0 ||
+                entry->expires + cache->stale_ttl <= now)) {
+        remove_entry(cache, entry);
+        return RESOLV_CACHE_MISS;
+    }
+
+    /* move to the front of the LRU list */
+    if (entry != TAILQ_FIRST(&cache->lru)) {
+        TAILQ_REMOVE(&cache->lru, entry, lru_entries);
+        TAILQ_INSERT_HEAD(&cache->lru, entry, lru_entries);
+    }
+
+    *addresses = entry->addresses;
+    *count = entry->address_count;
+
+    return stale ? RESOLV_CACHE_STALE : RESOLV_CACHE_HIT;
+}
+
+/*
+ * Cache a copy of addresses for hostname in mode for ttl seconds, or the
+ * negative TTL if count is zero, evicting the least recently used entry if
+ * the cache is full. Returns 1 if the addresses were cached.
+ */
+int
+resolv_cache_put(struct ResolvCache *cache, const char *hostname, int mode,
+        struct Address *const *addresses, size_t count, unsigned int ttl,
+        ev_tstamp now) {
+    size_t hostname_len = strlen(hostname);
+    uint32_t hash = hash_key(hostname, hostname_len, mode);
+    struct ResolvCacheEntry *entry =
+        find_entry(cache, hash, hostname, hostname_len, mode);
+
+    if (count == 0)
+        ttl = cache->negative_ttl;
+    else if (ttl < cache->min_ttl)
+        ttl = cache->min_ttl;
+    else if (ttl > cache->max_ttl)
+        ttl = cache->max_ttl;
+
+    if (entry != NULL)
+        remove_entry(cache, entry);
+    else if (cache->len >= cache->size && cache->len > 0)
+        remove_entry(cache, TAILQ_LAST(&cache->lru, ResolvCacheLRU));
+
+    if (cache->size == 0 || ttl == 0)
+        return 0;
+
+    entry = malloc(sizeof(struct ResolvCacheEntry) + hostname_len + 1);
+    if (entry == NULL) {
+        err("%s: malloc", __func__);
+        return 0;
+    }
+
+    entry->addresses = calloc(count > 0 ? count : 1, sizeof(struct Address *));
+    if (entry->addresses == NULL) {
+        err("%s: calloc", __func__);
+        free(entry);
+        return 0;
+    }
+
+    for (entry->address_count = 0; entry->address_count < count;
+            entry->address_count++) {
+        entry->addresses[entry->address_count] =
+            copy_address(addresses[entry->address_count]);
+        if (entry->addresses[entry->address_count] == NULL) {
+            err("%s: copy_address", __func__);
+            break;
+        }
+    }
+
+    entry->expires = now + ttl;
+    entry->hash = hash;
+    entry->mode = mode;
+    entry->hostname_len = hostname_len;
+    memcpy(entry->hostname, hostname, hostname_len + 1);
+
+    LIST_INSERT_HEAD(&cache->buckets[hash & cache->mask], entry, hash_entries);
+    TAILQ_INSERT_HEAD(&cache->lru, entry, lru_entries);
+    cache->len++;
+
+    return 1;
+}
+
+void
+resolv_cache_flush(struct ResolvCache *cache) {
+    struct ResolvCacheEntry *entry;
+
+    while ((entry = TAILQ_FIRST(&cache->lru)) != NULL)
+        remove_entry(cache, entry);
+}
+
+size_t
+resolv_cache_len(const struct ResolvCache *cache) {
+    return cache->len;
+}
+
+void
+free_resolv_cache(struct ResolvCache *cache) {
+    if (cache == NULL)
+        return;
+
+    resolv_cache_flush(cache);
+    free(cache->buckets);
+    free(cache);
+}
+
+static uint32_t
+hash_key(const char *hostname, size_t hostname_len, int mode) {
+    return hash_name(hostname, hostname_len) ^ ((uint32_t)mode * 0x9e3779b1u);
+}
+
+static struct ResolvCacheEntry *
+find_entry(const struct ResolvCache *cache, uint32_t hash,
+        const char *hostname, size_t hostname_len, int mode) {
+    struct ResolvCacheEntry *entry;
+
+    LIST_FOREACH(entry, &cache->buckets[hash & cache->mask], hash_entries)
+        if (entry->hash == hash && entry->mode == mode &&
+                entry->hostname_len == hostname_len &&
+                memcmp(entry->hostname, hostname, hostname_len) == 0)
+            return entry;
+
+    return NULL;
+}
+
+static void
+remove_entry(struct ResolvCache *cache, struct ResolvCacheEntry *entry) {
+    LIST_REMOVE(entry, hash_entries);
+    TAILQ_REMOVE(&cache->lru, entry, lru_entries);
+    cache->len--;
+
+    for (size_t i = 0; i < entry->address_count; i++)
+        free(entry->addresses[i]);
+    free(entry->addresses);
+    free(entry);
+}
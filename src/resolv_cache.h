@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2026, agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef RESOLV_CACHE_H
+#define RESOLV_CACHE_H
+
+#include <stddef.h>
+#include <ev.h>
+#include "address.h"
+
+#define DEFAULT_RESOLV_CACHE_SIZE 1024
+#define DEFAULT_RESOLV_CACHE_MIN_TTL 0
+#define DEFAULT_RESOLV_CACHE_MAX_TTL 3600
+#define DEFAULT_RESOLV_CACHE_NEGATIVE_TTL 0
+#define DEFAULT_RESOLV_CACHE_STALE_TTL 0
+
+enum ResolvCacheStatus {
+    RESOLV_CACHE_MISS = 0,
+    RESOLV_CACHE_HIT,
+    RESOLV_CACHE_STALE,
+};
+
+struct ResolvCache;
+
+struct ResolvCache *new_resolv_cache(size_t, unsigned int, unsigned int,
+        unsigned int, unsigned int);
+enum ResolvCacheStatus resolv_cache_get(struct ResolvCache *, const char *, int, ev_tstamp,
+        struct Address *const **, size_t *);
+int resolv_cache_put(struct ResolvCache *, const char *, int,
+        struct Address *const *, size_t, unsigned int, ev_tstamp);
+void resolv_cache_flush(struct ResolvCache *);
+size_t resolv_cache_len(const struct ResolvCache *);
+void free_resolv_cache(struct ResolvCache *);
+
+#endif
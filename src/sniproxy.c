@@ -43,16 +43,23 @@
 #include "connection.h"
 #include "listener.h"
 #include "resolv.h"
+#include "resolv_cache.h"
 #include "logger.h"
+#include "supervisor.h"
+#include "affinity.h"
+#include "worker.h"
+#include "name_hash.h"
 
 
 static void usage();
 static void daemonize(void);
 static void write_pidfile(const char *, pid_t);
 static void set_limits(rlim_t);
+static void set_event_backend(unsigned int);
 static void drop_perms(const char* username, const char* groupname);
 static void perror_exit(const char *);
 static void signal_cb(struct ev_loop *, struct ev_signal *, int revents);
+static void drain_cb(struct ev_loop *, struct ev_timer *, int revents);
 
 
 static const char *sniproxy_version = PACKAGE_VERSION;
@@ -62,6 +69,8 @@ static struct ev_signal sighup_watcher;
 static struct ev_signal sigusr1_watcher;
 static struct ev_signal sigint_watcher;
 static struct ev_signal sigterm_watcher;
+static struct ev_signal sigquit_watcher;
+static struct ev_timer drain_watcher;
 
 
 int
@@ -91,6 +100,9 @@ main(int argc, char **argv) {
         }
     }
 
+    /* before any tables or caches hash hostnames */
+    seed_name_hash();
+
     config = init_config(config_file, EV_DEFAULT);
     if (config == NULL) {
         fprintf(stderr, "Unable to load %s\n", config_file);
@@ -116,11 +128,29 @@ main(int argc, char **argv) {
 
     set_limits(max_nofiles);
 
+    if (config->event_backend != 0)
+        set_event_backend(config->event_backend);
+
     init_listeners(&config->listeners, &config->tables, EV_DEFAULT);
+    init_workers(config);
 
     /* Drop permissions only when we can */
     drop_perms(config->user ? config->user : default_username, config->group);
 
+    /* The supervisor only returns here once all worker processes exit */
+    if (config->worker_processes > 1 &&
+            supervise_worker_processes(config) == 0) {
+        free_config(config, EV_DEFAULT);
+        stop_binder();
+
+        return 0;
+    }
+
+    /* Worker processes are bound by the supervisor, otherwise this is the
+     * first worker */
+    if (config->worker_processes <= 1)
+        bind_cpu(worker_cpu(config, 0));
+
     ev_signal_init(&sighup_watcher, signal_cb, SIGHUP);
     ev_signal_init(&sigusr1_watcher, signal_cb, SIGUSR1);
     ev_signal_init(&sigint_watcher, signal_cb, SIGINT);
@@ -130,17 +160,33 @@ main(int argc, char **argv) {
     ev_signal_start(EV_DEFAULT, &sigint_watcher);
     ev_signal_start(EV_DEFAULT, &sigterm_watcher);
 
+    /* Graceful shutdown, used by the supervisor to retire worker processes */
+    if (config->workers <= 1) {
+        ev_signal_init(&sigquit_watcher, signal_cb, SIGQUIT);
+        ev_signal_start(EV_DEFAULT, &sigquit_watcher);
+    }
+
     resolv_init(EV_DEFAULT, config->resolver.nameservers,
-            config->resolver.search, config->resolver.mode);
+            config->resolver.search, config->resolver.mode,
+            new_resolv_cache(config->resolver.cache_size,
+                config->resolver.cache_min_ttl,
+                config->resolver.cache_max_ttl,
+                config->resolver.cache_negative_ttl,
+                config->resolver.cache_stale_ttl));
 
     init_connections();
 
+    start_workers(config);
+
     ev_run(EV_DEFAULT, 0);
 
+    stop_workers();
+
     free_connections(EV_DEFAULT);
     resolv_shutdown(EV_DEFAULT);
 
     free_config(config, EV_DEFAULT);
+    free_backend_jit_stack();
 
     stop_binder();
 
@@ -209,6 +255,26 @@ set_limits(rlim_t max_nofiles) {
         warn("Failed to set file handle limit: %s", strerror(errno));
 }
 
+/*
+ * The default loop was created with libev's default backend while loading the
+ * configuration, recreate it before any watchers are started
+ */
+static void
+set_event_backend(unsigned int backend) {
+    if (ev_backend(EV_DEFAULT) == backend)
+        return;
+
+    ev_loop_destroy(EV_DEFAULT);
+    if (ev_default_loop(backend) == NULL) {
+        if (ev_default_loop(EVFLAG_AUTO) == NULL)
+            fatal("Failed to create event loop");
+
+        warn("%s event backend is not supported, using %s instead",
+                event_backend_name(backend),
+                event_backend_name(ev_backend(EV_DEFAULT)));
+    }
+}
+
 static void
 drop_perms(const char *username, const char *groupname) {
     /* check if we are already an unprivileged user */
@@ -276,11 +342,26 @@ signal_cb(struct ev_loop *loop, struct ev_signal *w, int revents) {
     if (revents & EV_SIGNAL) {
         switch (w->signum) {
             case SIGHUP:
+                pause_workers();
                 reopen_loggers();
                 reload_config(config, loop);
+                reload_workers(config);
+                resume_workers();
                 break;
             case SIGUSR1:
-                print_connections();
+                print_connections(&config->listeners);
+                print_worker_connections();
+                break;
+            case SIGQUIT:
+                if (ev_is_active(&drain_watcher))
+                    break;
+
+                notice("no longer accepting connections, exiting once %zu "
+                        "connections close", connection_count());
+                free_listeners(&config->listeners, loop);
+
+                ev_timer_init(&drain_watcher, drain_cb, 0.0, 1.0);
+                ev_timer_start(loop, &drain_watcher);
                 break;
             case SIGINT:
             case SIGTERM:
@@ -288,3 +369,11 @@ signal_cb(struct ev_loop *loop, struct ev_signal *w, int revents) {
         }
     }
 }
+
+static void
+drain_cb(struct ev_loop *loop, struct ev_timer *w, int revents) {
+    if ((revents & EV_TIMER) && connection_count() == 0) {
+        ev_timer_stop(loop, w);
+        ev_unloop(loop, EVUNLOOP_ALL);
+    }
+}
@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2026, agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "suffix_trie.h"
+#include "logger.h"
+
+#ifndef MIN
+#define MIN(X, Y) ((X) < (Y) ? (X) : (Y))
+#endif
+
+
+struct SuffixTrieNode {
+    char *label;
+    size_t label_len;
+    size_t exact;       /* smallest value of exact entries ending here */
+    size_t wildcard;    /* smallest value of wildcard entries ending here */
+    struct SuffixTrieNode *children; /* sorted by label */
+    size_t children_len;
+    size_t children_size;
+};
+
+struct SuffixTrie {
+    struct SuffixTrieNode root;
+};
+
+
+static struct SuffixTrieNode *insert_name(struct SuffixTrieNode *,
+        const char *, size_t);
+static int compare_entries(const void *, const void *);
+static int compare_labels(const char *, size_t, const char *, size_t);
+static inline size_t label_start(const char *, size_t);
+static struct SuffixTrieNode *append_child(struct SuffixTrieNode *,
+        const char *, size_t);
+static const struct SuffixTrieNode *find_child(const struct SuffixTrieNode *,
+        const char *, size_t);
+static void free_node(struct SuffixTrieNode *);
+
+
+/*
+ * Build a suffix trie from entries, entries is reordered in the process.
+ *
+ * Sorting the entries by their reversed labels first means each new label
+ * sorts after all existing children of its parent, so children arrays are
+ * built in order by appending.
+ */
+struct SuffixTrie *
+new_suffix_trie(struct SuffixTrieEntry *entries, size_t entries_len) {
+    struct SuffixTrie *trie = calloc(1, sizeof(struct SuffixTrie));
+    if (trie == NULL) {
+        err("%s: calloc", __func__);
+        return NULL;
+    }
+    trie->root.exact = SUFFIX_TRIE_NONE;
+    trie->root.wildcard = SUFFIX_TRIE_NONE;
+
+    qsort(entries, entries_len, sizeof(struct SuffixTrieEntry), compare_entries);
+
+    for (size_t i = 0; i < entries_len; i++) {
+        struct SuffixTrieNode *node = insert_name(&trie->root,
+                entries[i].name, entries[i].name_len);
+        if (node == NULL) {
+            free_suffix_trie(trie);
+            return NULL;
+        }
+
+        if (entries[i].wildcard)
+            node->wildcard = MIN(node->wildcard, entries[i].value);
+        else
+            node->exact = MIN(node->exact, entries[i].value);
+    }
+
+    return trie;
+}
+
+/*
+ * Find the smallest value of all the entries matching name
+ *
+ * Returns SUFFIX_TRIE_NONE if no entry matches
+ */
+size_t
+suffix_trie_lookup(const struct SuffixTrie *trie, const char *name, size_t name_len) {
+    const struct SuffixTrieNode *node = &trie->root;
+    size_t result = node->wildcard;
+    size_t end = name_len;
+
+    if (name_len == 0)
+        return MIN(result, node->exact);
+
+    for (;;) {
+        size_t start = label_start(name, end);
+
+        node = find_child(node, name + start, end - start);
+        if (node == NULL)
+            break;
+
+        if (start == 0) {
+            result = MIN(result, node->exact);
+            break;
+        }
+
+        /* Additional labels remain, so wildcard entries match */
+        result = MIN(result, node->wildcard);
+        end = start - 1;
+    }
+
+    return result;
+}
+
+void
+free_suffix_trie(struct SuffixTrie *trie) {
+    if (trie == NULL)
+        return;
+
+    free_node(&trie->root);
+    free(trie);
+}
+
+/*
+ * Find or create the node for name, names must be inserted in the order
+ * established by compare_entries()
+ */
+static struct SuffixTrieNode *
+insert_name(struct SuffixTrieNode *node, const char *name, size_t name_len) {
+    size_t end = name_len;
+
+    if (name_len == 0)
+        return node;
+
+    for (;;) {
+        size_t start = label_start(name, end);
+        const char *label = name + start;
+        size_t label_len = end - start;
+        struct SuffixTrieNode *last = node->children_len > 0 ?
+            &node->children[node->children_len - 1] : NULL;
+
+        if (last != NULL && compare_labels(last->label, last->label_len,
+                    label, label_len) == 0) {
+            node = last;
+        } else {
+            assert(last == NULL || compare_labels(last->label,
+                        last->label_len, label, label_len) < 0);
+
+            node = append_child(node, label, label_len);
+            if (node == NULL)
+                return NULL;
+        }
+
+        if (start == 0)
+            return node;
+
+        end = start - 1; /* skip '.' separator */
+    }
+}
+
+/*
+ * Order entries by their labels compared right to left, so a parent sorts
+ * before all names below it
+ */
+static int
+compare_entries(const void *a, const void *b) {
+    const struct SuffixTrieEntry *entry_a = (const struct SuffixTrieEntry *)a;
+    const struct SuffixTrieEntry *entry_b = (const struct SuffixTrieEntry *)b;
+    size_t end_a = entry_a->name_len;
+    size_t end_b = entry_b->name_len;
+
+    /* An empty name has no labels and is stored at the root */
+    if (end_a == 0 || end_b == 0)
+        return (end_a > 0) - (end_b > 0);
+
+    for (;;) {
+        size_t start_a = label_start(entry_a->name, end_a);
+        size_t start_b = label_start(entry_b->name, end_b);
+
+        int result = compare_labels(entry_a->name + start_a, end_a - start_a,
+                entry_b->name + start_b, end_b - start_b);
+        if (result != 0)
+            return result;
+
+        /* one or both names have no more labels */
+        if (start_a == 0 || start_b == 0)
+            return (start_a != 0) - (start_b != 0);
+
+        end_a = start_a - 1; /* skip '.' separator */
+        end_b = start_b - 1;
+    }
+}
+
+static int
+compare_labels(const char *a, size_t a_len, const char *b, size_t b_len) {
+    int result = memcmp(a, b, MIN(a_len, b_len));
+    if (result != 0)
+        return result;
+
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+/*
+ * Find the start of the last label in name[0, end)
+ */
+static inline size_t
+label_start(const char *name, size_t end) {
+    while (end > 0 && name[end - 1] != '.')
+        end--;
+
+    return end;
+}
+
+static struct SuffixTrieNode *
+append_child(struct SuffixTrieNode *node, const char *label, size_t label_len) {
+    if (node->children_len == node->children_size) {
+        size_t new_size = node->children_size ? node->children_size * 2 : 4;
+        struct SuffixTrieNode *new_children = realloc(node->children,
+                new_size * sizeof(struct SuffixTrieNode));
+        if (new_children == NULL) {
+            err("%s: realloc", __func__);
+            return NULL;
+        }
+        node->children = new_children;
+        node->children_size = new_size;
+    }
+
+    struct SuffixTrieNode *child = &node->children[node->children_len];
+    child->label = malloc(label_len + 1);
+    if (child->label == NULL) {
+        err("%s: malloc", __func__);
+        return NULL;
+    }
+    memcpy(child->label, label, label_len);
+    child->label[label_len] = '\0';
+    child->label_len = label_len;
+    child->exact = SUFFIX_TRIE_NONE;
+    child->wildcard = SUFFIX_TRIE_NONE;
+    child->children = NULL;
+    child->children_len = 0;
+    child->children_size = 0;
+    node->children_len++;
+
+    return child;
+}
+
+static const struct SuffixTrieNode *
+find_child(const struct SuffixTrieNode *node, const char *label, size_t label_len) {
+    size_t low = 0;
+    size_t high = node->children_len;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const struct SuffixTrieNode *child = &node->children[mid];
+        int result = compare_labels(child->label, child->label_len,
+                label, label_len);
+
+        if (result == 0)
+            return child;
+        else if (result < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return NULL;
+}
+
+static void
+free_node(struct SuffixTrieNode *node) {
+    for (size_t i = 0; i < node->children_len; i++)
+        free_node(&node->children[i]);
+
+    free(node->children);
+    free(node->label);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2026, agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SUFFIX_TRIE_H
+#define SUFFIX_TRIE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SUFFIX_TRIE_NONE SIZE_MAX
+
+/*
+ * Hostnames are stored split at label boundaries and reversed, so
+ * www.example.com is stored as com -> example -> www.
+ *
+ * An exact entry only matches the name itself, a wildcard entry matches any
+ * name ending in '.' followed by the entry name, and a wildcard entry with
+ * an empty name matches every name.
+ */
+struct SuffixTrieEntry {
+    const char *name;
+    size_t name_len;
+    int wildcard;
+    size_t value;
+};
+
+struct SuffixTrie;
+
+struct SuffixTrie *new_suffix_trie(struct SuffixTrieEntry *, size_t);
+size_t suffix_trie_lookup(const struct SuffixTrie *, const char *, size_t);
+void free_suffix_trie(struct SuffixTrie *);
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2026, agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/queue.h>
+#include <ev.h>
+#include "supervisor.h"
+#include "affinity.h"
+#include "logger.h"
+
+/*
+ * Pre-forked worker processes: the listening sockets are bound before
+ * forking, each worker inherits them and runs its own event loop. The
+ * supervising process runs no event loop, it restarts workers which exit
+ * unexpectedly and relays signals to the workers.
+ *
+ * On reload the supervisor applies the new configuration itself and starts a
+ * new generation of workers from it, the previous workers are sent SIGQUIT
+ * to stop accepting connections and exit once their connections have closed.
+ * So workers never run a partially applied configuration and restarted
+ * workers always start from the current one.
+ */
+
+#define RESPAWN_INTERVAL 1 /* seconds */
+
+struct WorkerProcess {
+    pid_t pid;
+    size_t id;
+    int retiring;
+    time_t started;
+    SLIST_ENTRY(WorkerProcess) entries;
+};
+
+SLIST_HEAD(WorkerProcess_head, WorkerProcess);
+
+
+static int spawn_worker_processes(struct WorkerProcess_head *,
+        const struct Config *, size_t, size_t, const sigset_t *);
+static int reap_worker_processes(struct WorkerProcess_head *,
+        const struct Config *, int, const sigset_t *);
+static void signal_worker_processes(struct WorkerProcess_head *, int, int);
+static void free_worker_processes(struct WorkerProcess_head *);
+
+
+/*
+ * Fork config->worker_processes workers and supervise them. Returns 1 in the
+ * worker processes, and 0 in the supervisor once every worker has exited.
+ */
+int
+supervise_worker_processes(struct Config *config) {
+    struct WorkerProcess_head processes = SLIST_HEAD_INITIALIZER(processes);
+    sigset_t signals, saved_signals;
+    int stopping = 0;
+
+    /* Signals are handled synchronously by the supervisor */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGQUIT);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, &saved_signals);
+
+    notice("starting %zu worker processes", config->worker_processes);
+    if (spawn_worker_processes(&processes, config, 0,
+                config->worker_processes, &saved_signals) == 0)
+        return 1;
+
+    while (!stopping || !SLIST_EMPTY(&processes)) {
+        int signum;
+
+        if (sigwait(&signals, &signum) != 0)
+            continue;
+
+        switch (signum) {
+            case SIGCHLD:
+                if (reap_worker_processes(&processes, config, stopping,
+                            &saved_signals) == 0)
+                    return 1;
+                break;
+            case SIGHUP:
+                reopen_loggers();
+                reload_config(config, EV_DEFAULT);
+
+                signal_worker_processes(&processes, SIGQUIT, 1);
+                if (spawn_worker_processes(&processes, config, 0,
+                            config->worker_processes, &saved_signals) == 0)
+                    return 1;
+                break;
+            case SIGUSR1:
+                signal_worker_processes(&processes, SIGUSR1, 0);
+                break;
+            case SIGQUIT:
+                stopping = 1;
+                signal_worker_processes(&processes, SIGQUIT, 1);
+                break;
+            case SIGINT:
+            case SIGTERM:
+                stopping = 1;
+                signal_worker_processes(&processes, SIGTERM, 1);
+                break;
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &saved_signals, NULL);
+
+    return 0;
+}
+
+/*
+ * Start the workers numbered first to first + count - 1, a worker keeps its
+ * number and so its CPU when restarted. Returns 0 in the new worker processes
+ * and 1 in the supervisor.
+ */
+static int
+spawn_worker_processes(struct WorkerProcess_head *processes,
+        const struct Config *config, size_t first, size_t count,
+        const sigset_t *saved_signals) {
+    for (size_t id = first; id < first + count; id++) {
+        struct WorkerProcess *process = malloc(sizeof(struct WorkerProcess));
+        if (process == NULL) {
+            err("%s: malloc", __func__);
+            return 1;
+        }
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            err("fork: %s", strerror(errno));
+            free(process);
+            return 1;
+        } else if (pid == 0) {
+            free(process);
+            free_worker_processes(processes);
+
+            sigprocmask(SIG_SETMASK, saved_signals, NULL);
+            bind_cpu(worker_cpu(config, id));
+            ev_loop_fork(EV_DEFAULT);
+
+            return 0;
+        }
+
+        process->pid = pid;
+        process->id = id;
+        process->retiring = 0;
+        process->started = time(NULL);
+        SLIST_INSERT_HEAD(processes, process, entries);
+    }
+
+    return 1;
+}
+
+/*
+ * Collect exited workers, restarting them unless they were retired. Returns
+ * 0 in a restarted worker process and 1 in the supervisor.
+ */
+static int
+reap_worker_processes(struct WorkerProcess_head *processes,
+        const struct Config *config, int stopping,
+        const sigset_t *saved_signals) {
+    pid_t pid;
+    int status;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        struct WorkerProcess *process;
+
+        SLIST_FOREACH(process, processes, entries)
+            if (process->pid == pid)
+                break;
+
+        /* e.g. the binder */
+        if (process == NULL)
+            continue;
+
+        SLIST_REMOVE(processes, process, WorkerProcess, entries);
+        int restart = !stopping && !process->retiring;
+        size_t id = process->id;
+        time_t started = process->started;
+        free(process);
+
+        if (!restart) {
+            info("worker process %d exited", pid);
+            continue;
+        }
+
+        if (WIFSIGNALED(status))
+            warn("worker process %d killed by signal %d, restarting",
+                    pid, WTERMSIG(status));
+        else
+            warn("worker process %d exited with status %d, restarting",
+                    pid, WEXITSTATUS(status));
+
+        /* Do not fork continuously if workers fail on start up */
+        if (time(NULL) - started < RESPAWN_INTERVAL)
+            sleep(RESPAWN_INTERVAL);
+
+        if (spawn_worker_processes(processes, config, id, 1,
+                    saved_signals) == 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+static void
+signal_worker_processes(struct WorkerProcess_head *processes, int signum,
+        int retire) {
+    struct WorkerProcess *process;
+
+    SLIST_FOREACH(process, processes, entries) {
+        if (retire)
+            process->retiring = 1;
+
+        if (kill(process->pid, signum) < 0)
+            warn("kill(%d): %s", process->pid, strerror(errno));
+    }
+}
+
+static void
+free_worker_processes(struct WorkerProcess_head *processes) {
+    struct WorkerProcess *process;
+
+    while ((process = SLIST_FIRST(processes)) != NULL) {
+        SLIST_REMOVE_HEAD(processes, entries);
+        free(process);
+    }
+}
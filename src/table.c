@@ -36,14 +36,25 @@
 
 static void free_table(struct Table *);
 
+static unsigned int table_generation = 0;
+
 
 static inline struct Backend *
-table_lookup_backend(const struct Table *table, const char *name, size_t name_len) {
-    return lookup_backend(&table->backends, name, name_len);
+table_lookup_backend(const struct Table *table, const char *name, size_t name_len,
+        const char *alpn, size_t alpn_len) {
+    if (table->backend_index != NULL)
+        return lookup_backend_index(table->backend_index, name, name_len,
+                alpn, alpn_len);
+
+    return lookup_backend(&table->backends, name, name_len, alpn, alpn_len);
 }
 
 static inline void __attribute__((unused))
 remove_table_backend(struct Table *table, struct Backend *backend) {
+    free_backend_index(table->backend_index);
+    table->backend_index = NULL;
+    table->generation = ++table_generation;
+
     remove_backend(&table->backends, backend);
 }
 
@@ -60,8 +71,11 @@ new_table() {
 
     table->name = NULL;
     table->use_proxy_header = 0;
+    table->pcre_jit = 1;
     table->reference_count = 0;
     STAILQ_INIT(&table->backends);
+    table->backend_index = NULL;
+    table->generation = ++table_generation;
 
     return table;
 }
@@ -92,8 +106,16 @@ add_table(struct Table_head *tables, struct Table *table) {
 void init_table(struct Table *table) {
     struct Backend *iter;
 
-    STAILQ_FOREACH(iter, &table->backends, entries)
-        init_backend(iter);
+    table->alpn_backends = 0;
+    STAILQ_FOREACH(iter, &table->backends, entries) {
+        init_backend(iter, table->pcre_jit);
+        if (iter->alpn != NULL)
+            table->alpn_backends++;
+    }
+
+    if (table->backend_index == NULL)
+        table->backend_index = new_backend_index(&table->backends,
+                table->pcre_jit);
 }
 
 void
@@ -128,9 +150,15 @@ remove_table(struct Table_head *tables, struct Table *table) {
     table_ref_put(table);
 }
 
+/*
+ * Lookup the backend for name, alpn is the list of protocols offered by the
+ * client in the TLS ALPN extension
+ */
 struct LookupResult
-table_lookup_server_address(const struct Table *table, const char *name, size_t name_len) {
-    struct Backend *b = table_lookup_backend(table, name, name_len);
+table_lookup_server_address(const struct Table *table, const char *name,
+        size_t name_len, const char *alpn, size_t alpn_len) {
+    struct Backend *b = table_lookup_backend(table, name, name_len,
+            alpn, alpn_len);
     if (b == NULL) {
         info("No match found for %.*s", (int)name_len, name);
         return (struct LookupResult){.address = NULL};
@@ -176,6 +204,21 @@ reload_tables(struct Table_head *tables, struct Table_head *new_tables) {
             struct Backend_head temp = existing->backends;
             existing->backends = iter->backends;
             iter->backends = temp;
+
+            struct BackendIndex *temp_index = existing->backend_index;
+            existing->backend_index = iter->backend_index;
+            iter->backend_index = temp_index;
+
+            size_t temp_alpn_backends = existing->alpn_backends;
+            existing->alpn_backends = iter->alpn_backends;
+            iter->alpn_backends = temp_alpn_backends;
+
+            /* the index was built with the new table's JIT setting */
+            int temp_pcre_jit = existing->pcre_jit;
+            existing->pcre_jit = iter->pcre_jit;
+            iter->pcre_jit = temp_pcre_jit;
+
+            existing->generation = ++table_generation;
         } else {
             add_table(tables, iter);
         }
@@ -205,6 +248,8 @@ free_table(struct Table *table) {
     if (table == NULL)
         return;
 
+    free_backend_index(table->backend_index);
+
     while ((iter = STAILQ_FIRST(&table->backends)) != NULL)
         remove_backend(&table->backends, iter);
 
@@ -217,14 +262,16 @@ table_ref_put(struct Table *table) {
     if (table == NULL)
         return;
 
-    assert(table->reference_count > 0);
-    table->reference_count--;
-    if (table->reference_count == 0)
+    /* Listeners in different worker threads share tables */
+    int reference_count =
+        __atomic_sub_fetch(&table->reference_count, 1, __ATOMIC_ACQ_REL);
+    assert(reference_count >= 0);
+    if (reference_count == 0)
         free_table(table);
 }
 
 struct Table *
 table_ref_get(struct Table *table) {
-    table->reference_count++;
+    __atomic_add_fetch(&table->reference_count, 1, __ATOMIC_RELAXED);
     return table;
 }
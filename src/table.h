@@ -38,10 +38,14 @@ SLIST_HEAD(Table_head, Table);
 struct Table {
     char *name;
     int use_proxy_header;
+    int pcre_jit;
 
     /* Runtime fields */
     int reference_count;
     struct Backend_head backends;
+    struct BackendIndex *backend_index;
+    size_t alpn_backends;       /* backends restricted by ALPN */
+    unsigned int generation;    /* changes when backends are modified */
     SLIST_ENTRY(Table) entries;
 };
 
@@ -56,6 +60,7 @@ int accept_table_arg(struct Table *, const char *);
 void add_table(struct Table_head *, struct Table *);
 struct Table *table_lookup(const struct Table_head *, const char *);
 struct LookupResult table_lookup_server_address(const struct Table *,
+                                                const char *, size_t,
                                                 const char *, size_t);
 void reload_tables(struct Table_head *, struct Table_head *);
 void print_table_config(FILE *, struct Table *);
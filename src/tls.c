@@ -31,15 +31,15 @@
 #include <stdio.h>
 #include <stdlib.h> /* malloc() */
 #include <stdint.h>
-#include <string.h> /* strncpy() */
+#include <string.h> /* memcpy() */
 #include <sys/socket.h>
 #include <sys/types.h>
 #include "tls.h"
 #include "protocol.h"
 #include "logger.h"
 
-#define SERVER_NAME_LEN 256
 #define TLS_HEADER_LEN 5
+#define TLS_HANDSHAKE_HEADER_LEN 4
 #define TLS_HANDSHAKE_CONTENT_TYPE 0x16
 #define TLS_HANDSHAKE_TYPE_CLIENT_HELLO 0x01
 
@@ -49,8 +49,17 @@
 
 
 static int parse_tls_header(const uint8_t*, size_t, char **);
-static int parse_extensions(const uint8_t*, size_t, char **);
-static int parse_server_name_extension(const uint8_t*, size_t, char **);
+static int resume_tls_header(const uint8_t*, size_t, char *,
+        struct ParseState *);
+static int reassemble_handshake(const uint8_t*, size_t, uint8_t **,
+        struct ParseState *);
+static int parse_client_hello(const uint8_t*, size_t, uint8_t, uint8_t, char *,
+        struct ParseState *);
+static size_t handshake_length(const uint8_t*);
+static int parse_extensions(const uint8_t*, size_t, char *,
+        struct ParseState *);
+static int parse_server_name_extension(const uint8_t*, size_t, char *);
+static void parse_alpn_extension(const uint8_t*, size_t, struct ParseState *);
 
 
 static const char tls_alert[] = {
@@ -64,6 +73,8 @@ const struct Protocol *const tls_protocol = &(struct Protocol){
     .name = "tls",
     .default_port = 443,
     .parse_packet = (int (*const)(const char *, size_t, char **))&parse_tls_header,
+    .resume_parse = (int (*const)(const char *, size_t, char *,
+                struct ParseState *))&resume_tls_header,
     .abort_message = tls_alert,
     .abort_message_len = sizeof(tls_alert)
 };
@@ -84,6 +95,20 @@ const struct Protocol *const tls_protocol = &(struct Protocol){
  */
 static int
 parse_tls_header(const uint8_t *data, size_t data_len, char **hostname) {
+    return parse_packet_copy((int (*)(const char *, size_t, char *,
+                    struct ParseState *))&resume_tls_header,
+            (const char *)data, data_len, hostname);
+}
+
+/*
+ * As parse_tls_header(), but nothing is parsed until the records holding the
+ * entire client hello have been received, so a client hello trickling in over
+ * many reads is only parsed once. The hostname is copied to the
+ * HOSTNAME_MAX_LEN + 1 byte buffer hostname.
+ */
+static int
+resume_tls_header(const uint8_t *data, size_t data_len, char *hostname,
+        struct ParseState *state) {
     uint8_t tls_content_type;
     uint8_t tls_version_major;
     uint8_t tls_version_minor;
@@ -93,9 +118,14 @@ parse_tls_header(const uint8_t *data, size_t data_len, char **hostname) {
     if (hostname == NULL)
         return -3;
 
+    if (data_len < state->need)
+        return -1;
+
     /* Check that our TCP payload is at least large enough for a TLS header */
-    if (data_len < TLS_HEADER_LEN)
+    if (data_len < TLS_HEADER_LEN) {
+        state->need = TLS_HEADER_LEN;
         return -1;
+    }
 
     /* SSL 2.0 compatible Client Hello
      *
@@ -126,16 +156,17 @@ parse_tls_header(const uint8_t *data, size_t data_len, char **hostname) {
     /* TLS record length */
     len = ((size_t)data[3] << 8) +
         (size_t)data[4] + TLS_HEADER_LEN;
-    data_len = MIN(data_len, len);
 
     /* Check we received entire TLS record length */
-    if (data_len < len)
+    if (data_len < len) {
+        state->need = len;
         return -1;
+    }
 
     /*
      * Handshake
      */
-    if (pos + 1 > data_len) {
+    if (pos + 1 > len) {
         return -5;
     }
     if (data[pos] != TLS_HANDSHAKE_TYPE_CLIENT_HELLO) {
@@ -144,6 +175,100 @@ parse_tls_header(const uint8_t *data, size_t data_len, char **hostname) {
         return -5;
     }
 
+    /* Client hello continues in the following records */
+    if (pos + TLS_HANDSHAKE_HEADER_LEN > len ||
+            pos + TLS_HANDSHAKE_HEADER_LEN + handshake_length(data + pos) > len) {
+        uint8_t *hello;
+        int result = reassemble_handshake(data, data_len, &hello, state);
+        if (result < 0)
+            return result;
+
+        result = parse_client_hello(hello, (size_t)result,
+                tls_version_major, tls_version_minor, hostname, state);
+        free(hello);
+
+        return result;
+    }
+
+    /* Parse in place when the client hello fits in a single record */
+    return parse_client_hello(data + pos, len - pos,
+            tls_version_major, tls_version_minor, hostname, state);
+}
+
+/*
+ * Gather a handshake message fragmented across consecutive TLS handshake
+ * records into a newly allocated buffer, which the caller must free.
+ *
+ * Returns the length of the message, -1 if the records holding the
+ * remainder of the message have not been received, -4 on malloc failure or
+ * < -4 if the records are invalid
+ */
+static int
+reassemble_handshake(const uint8_t *data, size_t data_len, uint8_t **message,
+        struct ParseState *state) {
+    uint8_t header[TLS_HANDSHAKE_HEADER_LEN];
+    size_t header_len = 0;
+    size_t message_len = 0;
+    size_t received = 0;
+    size_t pos = 0;
+    size_t len;
+
+    /* Find the record holding the end of the message */
+    while (header_len < sizeof(header) || received < message_len) {
+        if (pos + TLS_HEADER_LEN > data_len) {
+            state->need = pos + TLS_HEADER_LEN;
+            return -1;
+        }
+        if (data[pos] != TLS_HANDSHAKE_CONTENT_TYPE) {
+            debug("Client hello interleaved with other TLS records");
+            return -5;
+        }
+
+        len = ((size_t)data[pos + 3] << 8) + (size_t)data[pos + 4];
+        pos += TLS_HEADER_LEN;
+        if (pos + len > data_len) {
+            state->need = pos + len;
+            return -1;
+        }
+
+        for (size_t i = 0; i < len && header_len < sizeof(header); i++)
+            header[header_len++] = data[pos + i];
+        if (header_len == sizeof(header))
+            message_len = TLS_HANDSHAKE_HEADER_LEN + handshake_length(header);
+
+        received += len;
+        pos += len;
+    }
+
+    *message = malloc(message_len);
+    if (*message == NULL) {
+        err("malloc() failure");
+        return -4;
+    }
+
+    /* Copy each fragment */
+    received = 0;
+    for (pos = 0; received < message_len; pos += TLS_HEADER_LEN + len) {
+        len = ((size_t)data[pos + 3] << 8) + (size_t)data[pos + 4];
+
+        size_t fragment_len = MIN(len, message_len - received);
+        memcpy(*message + received, data + pos + TLS_HEADER_LEN, fragment_len);
+        received += fragment_len;
+    }
+
+    return (int)message_len;
+}
+
+/*
+ * Parse a client hello handshake message, beginning with the handshake type
+ */
+static int
+parse_client_hello(const uint8_t *data, size_t data_len,
+        uint8_t tls_version_major, uint8_t tls_version_minor, char *hostname,
+        struct ParseState *state) {
+    size_t pos = 0;
+    size_t len;
+
     /* Skip past fixed length records:
        1	Handshake Type
        3	Length
@@ -184,13 +309,27 @@ parse_tls_header(const uint8_t *data, size_t data_len, char **hostname) {
 
     if (pos + len > data_len)
         return -5;
-    return parse_extensions(data + pos, len, hostname);
+    return parse_extensions(data + pos, len, hostname, state);
+}
+
+static size_t
+handshake_length(const uint8_t *header) {
+    return ((size_t)header[1] << 16) + ((size_t)header[2] << 8) +
+        (size_t)header[3];
 }
 
+/*
+ * Parse the server name extension, and record the protocols offered in the
+ * ALPN extension in state
+ */
 static int
-parse_extensions(const uint8_t *data, size_t data_len, char **hostname) {
+parse_extensions(const uint8_t *data, size_t data_len, char *hostname,
+        struct ParseState *state) {
     size_t pos = 0;
     size_t len;
+    int result = -2;
+
+    state->alpn_len = 0;
 
     /* Parse each 4 bytes for the extension header */
     while (pos + 4 <= data_len) {
@@ -200,14 +339,20 @@ parse_extensions(const uint8_t *data, size_t data_len, char **hostname) {
 
         /* Check if it's a server name extension */
         if (data[pos] == 0x00 && data[pos + 1] == 0x00) {
-            /* There can be only one extension of each type, so we break
-               our state and move p to beinnging of the extension here */
             if (pos + 4 + len > data_len)
                 return -5;
-            return parse_server_name_extension(data + pos + 4, len, hostname);
+            result = parse_server_name_extension(data + pos + 4, len, hostname);
+            if (result < 0)
+                return result;
+        } else if (data[pos] == 0x00 && data[pos + 1] == 0x10 &&
+                pos + 4 + len <= data_len) {
+            parse_alpn_extension(data + pos + 4, len, state);
         }
         pos += 4 + len; /* Advance to the next extension header */
     }
+    if (result >= 0)
+        return result;
+
     /* Check we ended where we expected to */
     if (pos != data_len)
         return -5;
@@ -215,9 +360,38 @@ parse_extensions(const uint8_t *data, size_t data_len, char **hostname) {
     return -2;
 }
 
+/*
+ * Copy the protocol name list of the ALPN extension to state, up to the last
+ * protocol name which fits. Malformed lists are ignored.
+ */
+static void
+parse_alpn_extension(const uint8_t *data, size_t data_len,
+        struct ParseState *state) {
+    size_t pos = 2; /* skip protocol name list length */
+    size_t len;
+
+    if (data_len < 2 || ((size_t)data[0] << 8) + (size_t)data[1] != data_len - 2)
+        return;
+
+    while (pos < data_len) {
+        len = (size_t)data[pos];
+        if (len == 0 || pos + 1 + len > data_len) {
+            state->alpn_len = 0;
+            return;
+        }
+
+        if (pos - 2 + 1 + len <= sizeof(state->alpn))
+            state->alpn_len = pos - 2 + 1 + len;
+
+        pos += 1 + len;
+    }
+
+    memcpy(state->alpn, data + 2, state->alpn_len);
+}
+
 static int
 parse_server_name_extension(const uint8_t *data, size_t data_len,
-        char **hostname) {
+        char *hostname) {
     size_t pos = 2; /* skip server name list length */
     size_t len;
 
@@ -230,17 +404,8 @@ parse_server_name_extension(const uint8_t *data, size_t data_len,
 
         switch (data[pos]) { /* name type */
             case 0x00: /* host_name */
-                *hostname = malloc(len + 1);
-                if (*hostname == NULL) {
-                    err("malloc() failure");
-                    return -4;
-                }
-
-                strncpy(*hostname, (const char *)(data + pos + 3), len);
-
-                (*hostname)[len] = '\0';
-
-                return len;
+                return copy_hostname(hostname,
+                        (const char *)(data + pos + 3), len);
             default:
                 debug("Unknown server name extension name type: %" PRIu8,
                       data[pos]);
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2026, agent <agent@local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <ev.h>
+#include "worker.h"
+#include "affinity.h"
+#include "backend.h"
+#include "connection.h"
+#include "listener.h"
+#include "resolv.h"
+#include "resolv_cache.h"
+#include "logger.h"
+
+/*
+ * Additional event loops, each running in its own thread with its own
+ * connections and its own socket bound to each listening address with
+ * SO_REUSEPORT, so the kernel distributes incoming connections between them.
+ * The main thread runs the first loop on EV_DEFAULT and handles signals.
+ *
+ * The tables and loggers are shared by every loop, configuration changes are
+ * only made by the main thread while the other workers are paused.
+ */
+struct Worker {
+    size_t id;
+    int cpu;
+    pthread_t thread;
+    struct ev_loop *loop;
+    struct ev_async wakeup;
+    struct Listener_head listeners;
+    int print_connections;
+};
+
+
+static void *worker_main(void *);
+static void wakeup_cb(struct ev_loop *, struct ev_async *, int);
+static void wakeup_workers();
+static void copy_listeners(struct Listener_head *, const struct Listener_head *,
+        int);
+
+
+static struct Worker *workers = NULL;
+static size_t worker_count = 0;
+static const struct Config *worker_config = NULL;
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;
+static size_t workers_started = 0;
+static size_t workers_paused = 0;
+static int pausing = 0;
+static int stopping = 0;
+
+
+/*
+ * Create the event loop and listening sockets of each additional worker,
+ * before dropping privileges so they can bind privileged ports
+ */
+void
+init_workers(struct Config *config) {
+    if (config->workers <= 1)
+        return;
+
+    worker_count = config->workers - 1;
+    workers = calloc(worker_count, sizeof(struct Worker));
+    if (workers == NULL)
+        fatal("%s: calloc", __func__);
+
+    for (size_t i = 0; i < worker_count; i++) {
+        struct Worker *worker = &workers[i];
+
+        worker->id = i + 1;
+        worker->cpu = worker_cpu(config, worker->id);
+        /* The main thread has already reported an unsupported backend */
+        worker->loop = ev_loop_new(config->event_backend);
+        if (worker->loop == NULL && config->event_backend != 0)
+            worker->loop = ev_loop_new(EVFLAG_AUTO);
+        if (worker->loop == NULL)
+            fatal("Failed to create event loop for worker %zu", worker->id);
+
+        ev_async_init(&worker->wakeup, wakeup_cb);
+        worker->wakeup.data = worker;
+        ev_async_start(worker->loop, &worker->wakeup);
+
+        SLIST_INIT(&worker->listeners);
+        copy_listeners(&worker->listeners, &config->listeners, worker->cpu);
+        init_listeners(&worker->listeners, &config->tables, worker->loop);
+    }
+}
+
+void
+start_workers(struct Config *config) {
+    sigset_t signals, saved_signals;
+
+    if (worker_count == 0)
+        return;
+
+    notice("starting %zu worker threads", worker_count);
+    worker_config = config;
+
+    /* Signals are handled by the main thread's default loop */
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, &saved_signals);
+
+    for (size_t i = 0; i < worker_count; i++) {
+        int result = pthread_create(&workers[i].thread, NULL, worker_main,
+                &workers[i]);
+        if (result != 0)
+            fatal("pthread_create(): %s", strerror(result));
+    }
+
+    pthread_sigmask(SIG_SETMASK, &saved_signals, NULL);
+
+    /* Wait until every worker has read its resolver configuration */
+    pthread_mutex_lock(&worker_lock);
+    while (workers_started < worker_count)
+        pthread_cond_wait(&worker_cond, &worker_lock);
+    pthread_mutex_unlock(&worker_lock);
+}
+
+/*
+ * Wait until every worker is blocked outside its event loop, so the
+ * configuration can be changed
+ */
+void
+pause_workers() {
+    if (worker_count == 0)
+        return;
+
+    pthread_mutex_lock(&worker_lock);
+    pausing = 1;
+    wakeup_workers();
+    while (workers_paused < worker_count)
+        pthread_cond_wait(&worker_cond, &worker_lock);
+    pthread_mutex_unlock(&worker_lock);
+}
+
+/*
+ * Apply the reloaded configuration to the listeners of each paused worker
+ */
+void
+reload_workers(struct Config *config) {
+    for (size_t i = 0; i < worker_count; i++) {
+        struct Worker *worker = &workers[i];
+        struct Listener_head new_listeners =
+            SLIST_HEAD_INITIALIZER(new_listeners);
+
+        copy_listeners(&new_listeners, &config->listeners, worker->cpu);
+        listeners_reload(&worker->listeners, &new_listeners,
+                &config->tables, worker->loop);
+        free_listeners(&new_listeners, worker->loop);
+    }
+}
+
+void
+resume_workers() {
+    if (worker_count == 0)
+        return;
+
+    pthread_mutex_lock(&worker_lock);
+    pausing = 0;
+    pthread_cond_broadcast(&worker_cond);
+    while (workers_paused > 0)
+        pthread_cond_wait(&worker_cond, &worker_lock);
+    pthread_mutex_unlock(&worker_lock);
+}
+
+/*
+ * Each worker dumps its own connections to a separate file
+ */
+void
+print_worker_connections() {
+    pthread_mutex_lock(&worker_lock);
+    for (size_t i = 0; i < worker_count; i++)
+        workers[i].print_connections = 1;
+    wakeup_workers();
+    pthread_mutex_unlock(&worker_lock);
+}
+
+void
+stop_workers() {
+    if (worker_count == 0)
+        return;
+
+    pthread_mutex_lock(&worker_lock);
+    stopping = 1;
+    wakeup_workers();
+    pthread_mutex_unlock(&worker_lock);
+
+    for (size_t i = 0; i < worker_count; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    for (size_t i = 0; i < worker_count; i++) {
+        struct Worker *worker = &workers[i];
+
+        free_listeners(&worker->listeners, worker->loop);
+        ev_async_stop(worker->loop, &worker->wakeup);
+        ev_loop_destroy(worker->loop);
+    }
+
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+}
+
+static void *
+worker_main(void *data) {
+    struct Worker *worker = (struct Worker *)data;
+    const struct ResolverConfig *resolver = &worker_config->resolver;
+
+    /* Before the resolver and connections allocate memory */
+    bind_cpu(worker->cpu);
+
+    resolv_init(worker->loop, resolver->nameservers, resolver->search,
+            resolver->mode,
+            new_resolv_cache(resolver->cache_size,
+                resolver->cache_min_ttl,
+                resolver->cache_max_ttl,
+                resolver->cache_negative_ttl,
+                resolver->cache_stale_ttl));
+
+    init_connections();
+
+    pthread_mutex_lock(&worker_lock);
+    workers_started++;
+    pthread_cond_broadcast(&worker_cond);
+    pthread_mutex_unlock(&worker_lock);
+
+    ev_run(worker->loop, 0);
+
+    free_connections(worker->loop);
+    resolv_shutdown(worker->loop);
+    free_backend_jit_stack();
+
+    return NULL;
+}
+
+/*
+ * Runs in the worker thread when woken by the main thread
+ */
+static void
+wakeup_cb(struct ev_loop *loop, struct ev_async *w, int revents) {
+    struct Worker *worker = (struct Worker *)w->data;
+    int print = 0, stop = 0;
+
+    if (!(revents & EV_ASYNC))
+        return;
+
+    pthread_mutex_lock(&worker_lock);
+    if (pausing) {
+        workers_paused++;
+        pthread_cond_broadcast(&worker_cond);
+        while (pausing)
+            pthread_cond_wait(&worker_cond, &worker_lock);
+        workers_paused--;
+        pthread_cond_broadcast(&worker_cond);
+    }
+    print = worker->print_connections;
+    worker->print_connections = 0;
+    stop = stopping;
+    pthread_mutex_unlock(&worker_lock);
+
+    if (print)
+        print_connections(&worker->listeners);
+
+    if (stop)
+        ev_break(loop, EVBREAK_ALL);
+}
+
+static void
+wakeup_workers() {
+    for (size_t i = 0; i < worker_count; i++)
+        ev_async_send(workers[i].loop, &workers[i].wakeup);
+}
+
+/*
+ * Only listeners using SO_REUSEPORT can be bound again by each worker, UNIX
+ * domain sockets are served by the main thread alone
+ */
+static void
+copy_listeners(struct Listener_head *copies,
+        const struct Listener_head *listeners, int incoming_cpu) {
+    struct Listener *iter;
+    char address[ADDRESS_BUFFER_SIZE];
+
+    SLIST_FOREACH(iter, listeners, entries) {
+        if (!iter->reuseport)
+            continue;
+
+        struct Listener *copy = clone_listener(iter);
+        if (copy == NULL) {
+            err("Failed to copy listener %s",
+                    display_address(iter->address, address, sizeof(address)));
+            continue;
+        }
+
+        copy->incoming_cpu = incoming_cpu;
+        add_listener(copies, copy);
+    }
+}
@@ -1,8 +1,12 @@
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
 #include <ev.h>
 #include "buffer.h"
 
@@ -168,6 +172,270 @@ static void test_buffer_coalesce() {
     assert(len == 0);
 }
 
+static void test_buffer_splice() {
+    struct Buffer *buffer;
+    char input[] = "Test splice relay.";
+    char output[sizeof(input)];
+    int client[2], server[2];
+    ssize_t len;
+
+    buffer = new_buffer(256, EV_DEFAULT);
+    assert(buffer != NULL);
+
+    if (!buffer_splice(buffer)) {
+        /* splice not supported on this platform */
+        free_buffer(buffer);
+        return;
+    }
+    assert(buffer_is_spliced(buffer));
+    assert(buffer_room(buffer) > 0);
+
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, client) == 0);
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, server) == 0);
+
+    len = write(client[0], input, sizeof(input));
+    assert(len == sizeof(input));
+
+    len = buffer_recv(buffer, client[1], 0, EV_DEFAULT);
+    assert(len == sizeof(input));
+    assert(buffer_len(buffer) == sizeof(input));
+
+    /* data can not be pushed behind data held in the pipe */
+    len = buffer_push(buffer, input, sizeof(input));
+    assert(len == 0);
+
+    len = buffer_send(buffer, server[0], 0, EV_DEFAULT);
+    assert(len == sizeof(input));
+    assert(buffer_len(buffer) == 0);
+    assert(buffer->rx_bytes == sizeof(input));
+    assert(buffer->tx_bytes == sizeof(input));
+
+    len = read(server[1], output, sizeof(output));
+    assert(len == sizeof(input));
+    for (size_t i = 0; i < sizeof(input); i++)
+        assert(input[i] == output[i]);
+
+    /* an empty socket does not make the pipe look full */
+    assert(fcntl(client[1], F_SETFL, O_NONBLOCK) == 0);
+    len = write(client[0], input, sizeof(input));
+    assert(len == sizeof(input));
+    len = buffer_recv(buffer, client[1], 0, EV_DEFAULT);
+    assert(len == sizeof(input));
+    len = buffer_recv(buffer, client[1], 0, EV_DEFAULT);
+    assert(len < 0 && errno == EAGAIN);
+    assert(!buffer->pipe_full);
+    assert(buffer_room(buffer) > 0);
+
+    /* but data left waiting on the socket does */
+    assert(fcntl(client[0], F_SETFL, O_NONBLOCK) == 0);
+    assert(fcntl(server[0], F_SETFL, O_NONBLOCK) == 0);
+    for (size_t i = 0; i < 1024 && buffer_room(buffer) > 0; i++) {
+        char block[4096];
+        memset(block, 'x', sizeof(block));
+        if (write(client[0], block, sizeof(block)) < 0)
+            assert(errno == EAGAIN);
+        buffer_recv(buffer, client[1], 0, EV_DEFAULT);
+    }
+    assert(buffer->pipe_full);
+    assert(buffer_room(buffer) == 0);
+
+    len = buffer_send(buffer, server[0], 0, EV_DEFAULT);
+    assert(len > 0);
+    assert(!buffer->pipe_full);
+    assert(buffer_room(buffer) > 0);
+
+    close(client[0]);
+    close(client[1]);
+    close(server[0]);
+    close(server[1]);
+    free_buffer(buffer);
+}
+
+static void test_buffer_pool() {
+    struct Buffer *buffer;
+    char input[] = "Test pooled buffer resizing.";
+    char output[sizeof(input)];
+    ssize_t len;
+
+    buffer = new_buffer(4096, EV_DEFAULT);
+    assert(buffer != NULL);
+    char *storage = buffer->buffer;
+    free_buffer(buffer);
+
+    /* storage of a released buffer is reused */
+    buffer = new_buffer(4096, EV_DEFAULT);
+    assert(buffer != NULL);
+    assert(buffer->buffer == storage);
+
+    len = buffer_push(buffer, input, sizeof(input));
+    assert(len == sizeof(input));
+
+    len = buffer_resize(buffer, 16384);
+    assert(len == sizeof(input));
+    assert(buffer_size(buffer) == 16384);
+
+    len = buffer_resize(buffer, 4096);
+    assert(len == sizeof(input));
+    assert(buffer->buffer == storage);
+
+    len = buffer_pop(buffer, output, sizeof(output));
+    assert(len == sizeof(input));
+    assert(memcmp(input, output, sizeof(input)) == 0);
+
+    free_buffer(buffer);
+    free_buffer_pools();
+}
+
+static void test_buffer_read_only() {
+    static const char message[] = "Shared abort message.";
+    char output[sizeof(message)];
+    struct Buffer *buffer;
+    size_t len;
+
+    buffer = new_read_only_buffer(message, sizeof(message), EV_DEFAULT);
+    assert(buffer != NULL);
+    assert(buffer->buffer == message);
+    assert(buffer_len(buffer) == sizeof(message));
+    assert(buffer_room(buffer) == 0);
+
+    /* nothing can be added */
+    assert(buffer_push(buffer, "x", 1) == 0);
+    assert(buffer_resize(buffer, 4096) < 0);
+    assert(buffer_splice(buffer) == 0);
+
+    len = buffer_pop(buffer, output, 8);
+    assert(len == 8);
+    assert(buffer_len(buffer) == sizeof(message) - 8);
+
+    len = buffer_pop(buffer, output + 8, sizeof(output) - 8);
+    assert(len == sizeof(message) - 8);
+    assert(memcmp(output, message, sizeof(message)) == 0);
+    assert(buffer_room(buffer) == 0);
+
+    free_buffer(buffer);
+}
+
+static void test_buffer_mirrored() {
+    struct Buffer *buffer;
+    char input[4000];
+    char wrapped[100];
+    const void *data;
+    size_t len, head;
+
+    buffer = new_mirrored_buffer(4096, EV_DEFAULT);
+    assert(buffer != NULL);
+    if (!buffer->mirrored) {
+        /* not supported, regular storage is used */
+        free_buffer(buffer);
+        return;
+    }
+
+    memset(input, 'a', sizeof(input));
+    memset(wrapped, 'b', sizeof(wrapped));
+
+    len = buffer_push(buffer, input, sizeof(input));
+    assert(len == sizeof(input));
+    len = buffer_pop(buffer, NULL, sizeof(input) - 10);
+    assert(len == sizeof(input) - 10);
+
+    /* content wraps around the end of the storage */
+    len = buffer_push(buffer, wrapped, sizeof(wrapped));
+    assert(len == sizeof(wrapped));
+    assert(buffer->head + buffer_len(buffer) > buffer_size(buffer));
+
+    /* but is read in place */
+    head = buffer->head;
+    len = buffer_coalesce(buffer, &data);
+    assert(len == 10 + sizeof(wrapped));
+    assert(buffer->head == head);
+    assert(data == buffer->buffer + head);
+    assert(memcmp(data, input, 10) == 0);
+    assert(memcmp((const char *)data + 10, wrapped, sizeof(wrapped)) == 0);
+
+    /* resizing keeps the storage mirrored */
+    assert(buffer_resize(buffer, 8192) == (ssize_t)len);
+    assert(buffer->mirrored);
+    len = buffer_coalesce(buffer, &data);
+    assert(len == 10 + sizeof(wrapped));
+    assert(memcmp((const char *)data + 10, wrapped, sizeof(wrapped)) == 0);
+
+    free_buffer(buffer);
+    free_buffer_pools();
+}
+
+/* Push data so it wraps around the end of the buffer storage */
+static void push_wrapped(struct Buffer *buffer, const char *data, size_t len) {
+    static char filler[16384];
+    size_t offset = buffer_size(buffer) - len / 2;
+
+    assert(buffer_len(buffer) == 0 && offset <= sizeof(filler));
+    memset(filler, 'x', offset);
+
+    /* leave a byte behind so the head is not reset */
+    assert(buffer_push(buffer, filler, offset) == offset);
+    assert(buffer_pop(buffer, NULL, offset - 1) == offset - 1);
+    assert(buffer_push(buffer, data, len) == len);
+    assert(buffer_pop(buffer, NULL, 1) == 1);
+
+    assert(buffer->head + buffer_len(buffer) > buffer_size(buffer));
+}
+
+static void test_buffer_grow_shrink() {
+    struct Buffer *buffer;
+    char input[3000];
+    char output[sizeof(input)];
+    size_t len;
+
+    for (size_t i = 0; i < sizeof(input); i++)
+        input[i] = (char)('a' + i % 26);
+
+    buffer = new_buffer(4096, EV_DEFAULT);
+    assert(buffer != NULL);
+
+    /* growing doubles the size and keeps wrapped content */
+    push_wrapped(buffer, input, sizeof(input));
+    assert(buffer_grow(buffer, 16384) == 8192);
+    assert(buffer_grow(buffer, 16384) == 16384);
+    assert(buffer_room(buffer) == 16384 - sizeof(input));
+
+    /* but not beyond the maximum size */
+    assert(buffer_grow(buffer, 16384) == 16384);
+    assert(buffer_grow(buffer, 20000) == 16384);
+    assert(buffer_size(buffer) == 16384);
+
+    len = buffer_pop(buffer, output, sizeof(output));
+    assert(len == sizeof(input));
+    assert(memcmp(input, output, sizeof(input)) == 0);
+
+    /* shrinking keeps wrapped content */
+    push_wrapped(buffer, input, sizeof(input));
+    assert(buffer_shrink(buffer, 1024) == 4096);
+    assert(buffer_len(buffer) == sizeof(input));
+
+    len = buffer_pop(buffer, output, sizeof(output));
+    assert(len == sizeof(input));
+    assert(memcmp(input, output, sizeof(input)) == 0);
+
+    /* to the smallest size holding the content */
+    assert(buffer_grow(buffer, 16384) == 8192);
+    assert(buffer_push(buffer, input, sizeof(input)) == sizeof(input));
+    assert(buffer_push(buffer, input, sizeof(input)) == sizeof(input));
+    assert(buffer_shrink(buffer, 1024) == 8192);
+    assert(buffer_pop(buffer, NULL, sizeof(input)) == sizeof(input));
+    assert(buffer_shrink(buffer, 1024) == 4096);
+
+    len = buffer_pop(buffer, output, sizeof(output));
+    assert(len == sizeof(input));
+    assert(memcmp(input, output, sizeof(input)) == 0);
+
+    /* but no smaller than the minimum size, and never grows */
+    assert(buffer_shrink(buffer, 1024) == 1024);
+    assert(buffer_shrink(buffer, 4096) == 1024);
+
+    free_buffer(buffer);
+    free_buffer_pools();
+}
+
 int main() {
     test1();
 
@@ -178,4 +446,14 @@ int main() {
     test4();
 
     test_buffer_coalesce();
+
+    test_buffer_splice();
+
+    test_buffer_pool();
+
+    test_buffer_read_only();
+
+    test_buffer_mirrored();
+
+    test_buffer_grow_shrink();
 }
@@ -0,0 +1,72 @@
+#include <string.h>
+#include "client_hello.h"
+
+/*
+ * Build a single record TLS 1.2 client hello with a server name extension and
+ * the ALPN and padding extensions sent by current browsers. Returns the length
+ * of the client hello, or 0 if it does not fit in hello_len bytes.
+ */
+size_t
+client_hello(unsigned char *hello, size_t hello_len, const char *hostname) {
+    static const unsigned char alpn[] = {
+        0x00, 0x10, 0x00, 0x0e, 0x00, 0x0c,
+        0x02, 'h', '2',
+        0x08, 'h', 't', 't', 'p', '/', '1', '.', '1',
+    };
+    size_t name_len = strlen(hostname);
+    size_t pos = 0;
+
+    if (name_len > 255 || hello_len < CLIENT_HELLO_LEN)
+        return 0;
+    memset(hello, 0, hello_len);
+
+    hello[pos++] = 0x16; /* Content Type: Handshake */
+    hello[pos++] = 0x03; hello[pos++] = 0x01;
+    pos += 2; /* record length */
+    hello[pos++] = 0x01; /* Handshake Type: Client Hello */
+    pos += 3; /* handshake length */
+    hello[pos++] = 0x03; hello[pos++] = 0x03;
+    pos += 32; /* random */
+    hello[pos++] = 32; /* session ID */
+    pos += 32;
+    hello[pos++] = 0x00; hello[pos++] = 0x20; /* cipher suites */
+    for (int i = 0; i < 16; i++) {
+        hello[pos++] = 0xc0;
+        hello[pos++] = (unsigned char)(0x2b + i);
+    }
+    hello[pos++] = 0x01; hello[pos++] = 0x00; /* compression methods */
+
+    size_t extensions = pos;
+    pos += 2;
+
+    hello[pos++] = 0x00; hello[pos++] = 0x00; /* server name */
+    hello[pos++] = (unsigned char)((name_len + 5) >> 8);
+    hello[pos++] = (unsigned char)((name_len + 5) & 0xff);
+    hello[pos++] = (unsigned char)((name_len + 3) >> 8);
+    hello[pos++] = (unsigned char)((name_len + 3) & 0xff);
+    hello[pos++] = 0x00; /* host_name */
+    hello[pos++] = 0x00; hello[pos++] = (unsigned char)name_len;
+    memcpy(hello + pos, hostname, name_len);
+    pos += name_len;
+
+    memcpy(hello + pos, alpn, sizeof(alpn));
+    pos += sizeof(alpn);
+
+    /* padding extension to a 512 byte handshake message */
+    size_t padding = CLIENT_HELLO_LEN - pos - 4;
+    hello[pos++] = 0x00; hello[pos++] = 0x15;
+    hello[pos++] = (unsigned char)(padding >> 8);
+    hello[pos++] = (unsigned char)(padding & 0xff);
+    pos += padding;
+
+    hello[3] = (unsigned char)((pos - 5) >> 8);
+    hello[4] = (unsigned char)((pos - 5) & 0xff);
+    hello[6] = (unsigned char)((pos - 9) >> 16);
+    hello[7] = (unsigned char)((pos - 9) >> 8);
+    hello[8] = (unsigned char)((pos - 9) & 0xff);
+    hello[extensions] = (unsigned char)((pos - extensions - 2) >> 8);
+    hello[extensions + 1] = (unsigned char)((pos - extensions - 2) & 0xff);
+
+    return pos;
+}
+
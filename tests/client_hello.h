@@ -0,0 +1,10 @@
+#ifndef CLIENT_HELLO_H
+#define CLIENT_HELLO_H
+
+#include <stddef.h>
+
+#define CLIENT_HELLO_LEN (5 + 512)
+
+size_t client_hello(unsigned char *, size_t, const char *);
+
+#endif
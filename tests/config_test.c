@@ -1,6 +1,16 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
 #include <ev.h>
 #include "config.h"
 
+static void test_event_backend();
+static struct Config *parse_config_string(const char *);
+static struct Config *reparse_printed_config(struct Config *);
+
+
 int main(int argc, char **argv) {
     const char *config_file = "../sniproxy.conf";
     struct Config *config;
@@ -8,6 +18,8 @@ int main(int argc, char **argv) {
     if (argc >= 2)
         config_file = argv[1];
 
+    test_event_backend();
+
     config = init_config(config_file, EV_DEFAULT);
     if (config == NULL) {
         fprintf(stderr, "Failed to parse config\n");
@@ -20,3 +32,87 @@ int main(int argc, char **argv) {
 
     return 0;
 }
+
+static void
+test_event_backend() {
+    static const struct {
+        const char *name;
+        unsigned int backend;
+    } backends[] = {
+        { "auto", 0 },
+        { "select", EVBACKEND_SELECT },
+        { "poll", EVBACKEND_POLL },
+        { "epoll", EVBACKEND_EPOLL },
+        { "kqueue", EVBACKEND_KQUEUE },
+        { "EPOLL", EVBACKEND_EPOLL },
+#if HAVE_DECL_EVBACKEND_IOURING
+        { "io_uring", EVBACKEND_IOURING },
+#endif
+    };
+    struct Config *config;
+    char line[64];
+
+    /* defaults to libev's choice */
+    config = parse_config_string("");
+    assert(config != NULL);
+    assert(config->event_backend == 0);
+    free_config(config, EV_DEFAULT);
+
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        snprintf(line, sizeof(line), "event_backend %s\n", backends[i].name);
+
+        config = parse_config_string(line);
+        assert(config != NULL);
+        assert(config->event_backend == backends[i].backend);
+
+        /* print_config() output parses back to the same backend */
+        config = reparse_printed_config(config);
+        assert(config != NULL);
+        assert(config->event_backend == backends[i].backend);
+        free_config(config, EV_DEFAULT);
+    }
+
+    assert(parse_config_string("event_backend kqueue2\n") == NULL);
+
+#if !HAVE_DECL_EVBACKEND_IOURING
+    /* not offered when libev lacks io_uring support */
+    assert(parse_config_string("event_backend io_uring\n") == NULL);
+#endif
+}
+
+static struct Config *
+parse_config_string(const char *content) {
+    char filename[] = "/tmp/sniproxy-config-test-XXXXXX";
+    int fd = mkstemp(filename);
+    assert(fd >= 0);
+
+    size_t len = strlen(content);
+    assert(write(fd, content, len) == (ssize_t)len);
+    close(fd);
+
+    struct Config *config = init_config(filename, EV_DEFAULT);
+    unlink(filename);
+
+    return config;
+}
+
+/*
+ * Print config, free it and parse the printed configuration
+ */
+static struct Config *
+reparse_printed_config(struct Config *config) {
+    char filename[] = "/tmp/sniproxy-config-test-XXXXXX";
+    int fd = mkstemp(filename);
+    assert(fd >= 0);
+
+    FILE *file = fdopen(fd, "w");
+    assert(file != NULL);
+    print_config(file, config);
+    fclose(file);
+    free_config(config, EV_DEFAULT);
+
+    config = init_config(filename, EV_DEFAULT);
+    unlink(filename);
+
+    return config;
+}
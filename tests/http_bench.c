@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <time.h>
+#include "http.h"
+#include "http_scan.h"
+
+/*
+ * Measure the cost of locating the Host header in typical HTTP requests,
+ * comparing examining each header line in turn with skipping to candidate
+ * lines using each http_find_line implementation.
+ *
+ * Usage: http_bench [iterations]
+ */
+
+struct Corpus {
+    const char *name;
+    char *request;
+    size_t len;
+};
+
+struct Scanner {
+    const char *name;
+    size_t (*find_line)(const char *, size_t, char);
+};
+
+static void init_corpora(struct Corpus *);
+static char *cookie_request(size_t);
+static size_t per_line_scan(const char *, size_t);
+static size_t candidate_scan(size_t (*)(const char *, size_t, char),
+        const char *, size_t);
+static double elapsed(const struct timespec *, const struct timespec *);
+
+static const char curl_request[] =
+    "GET / HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: curl/8.5.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+static const char browser_request[] =
+    "GET /assets/app.js HTTP/1.1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+    "Accept: */*\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Referer: https://www.example.com/\r\n"
+    "Connection: keep-alive\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Host: www.example.com\r\n"
+    "\r\n";
+
+#define CORPORA 4
+static volatile size_t sink;
+
+
+int main(int argc, char **argv) {
+    size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    struct Corpus corpora[CORPORA];
+    struct Scanner scanners[] = {
+        { "scalar", http_find_line_scalar },
+#ifdef HTTP_SCAN_X86
+        { "sse2", http_find_line_sse2 },
+        { "avx2", http_scan_avx2_supported() ? http_find_line_avx2 : NULL },
+#endif
+    };
+
+    init_corpora(corpora);
+
+    for (int i = 0; i < CORPORA; i++) {
+        struct timespec start, end;
+        size_t host = per_line_scan(corpora[i].request, corpora[i].len);
+
+        printf("%s (%zu bytes):\n", corpora[i].name, corpora[i].len);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t j = 0; j < iterations; j++)
+            sink = per_line_scan(corpora[i].request, corpora[i].len);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("  %-10s %8.1f ns/request\n", "per line",
+                elapsed(&start, &end) / iterations);
+
+        for (size_t k = 0; k < sizeof(scanners) / sizeof(scanners[0]); k++) {
+            if (scanners[k].find_line == NULL)
+                continue;
+
+            assert(host == candidate_scan(scanners[k].find_line,
+                        corpora[i].request, corpora[i].len));
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (size_t j = 0; j < iterations; j++)
+                sink = candidate_scan(scanners[k].find_line,
+                        corpora[i].request, corpora[i].len);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            printf("  %-10s %8.1f ns/request\n", scanners[k].name,
+                    elapsed(&start, &end) / iterations);
+        }
+
+        /* complete parse using the implementation selected at run time */
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t j = 0; j < iterations; j++) {
+            struct ParseState state = { .offset = 0, .need = 0 };
+            char hostname[HOSTNAME_MAX_LEN + 1];
+            int result = http_protocol->resume_parse(corpora[i].request,
+                    corpora[i].len, hostname, &state);
+            assert(result > 0);
+            sink = (size_t)result;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("  %-10s %8.1f ns/request\n", "parse",
+                elapsed(&start, &end) / iterations);
+    }
+
+    for (int i = 2; i < CORPORA; i++)
+        free(corpora[i].request);
+
+    return 0;
+}
+
+static void
+init_corpora(struct Corpus *corpora) {
+    corpora[0] = (struct Corpus){ "curl", (char *)curl_request,
+        sizeof(curl_request) - 1 };
+    corpora[1] = (struct Corpus){ "browser", (char *)browser_request,
+        sizeof(browser_request) - 1 };
+    corpora[2].name = "1k cookies";
+    corpora[2].request = cookie_request(1024);
+    corpora[2].len = strlen(corpora[2].request);
+    corpora[3].name = "8k cookies";
+    corpora[3].request = cookie_request(8192);
+    corpora[3].len = strlen(corpora[3].request);
+}
+
+/*
+ * A browser request carrying about cookie_len bytes of cookies in several
+ * Cookie lines, with the Host header last
+ */
+static char *
+cookie_request(size_t cookie_len) {
+    size_t len = sizeof(browser_request) + cookie_len + cookie_len / 8 + 64;
+    char *request = malloc(len);
+    size_t pos, written = 0;
+    assert(request != NULL);
+
+    /* browser request headers without Host and the blank line */
+    pos = (size_t)(strstr(browser_request, "Host:") - browser_request);
+    memcpy(request, browser_request, pos);
+
+    while (written < cookie_len) {
+        pos += (size_t)sprintf(request + pos, "Cookie: ");
+        for (int i = 0; i < 16 && written < cookie_len; i++) {
+            int n = sprintf(request + pos, "c%02d=%08x%08x%08x; ", i,
+                    (unsigned int)(written * 2654435761u),
+                    (unsigned int)(written * 40503u),
+                    (unsigned int)written);
+            pos += (size_t)n;
+            written += (size_t)n;
+        }
+        pos += (size_t)sprintf(request + pos, "\r\n");
+    }
+    sprintf(request + pos, "Host: www.example.com\r\n\r\n");
+
+    return request;
+}
+
+/*
+ * Returns the offset of the Host header examining each line
+ */
+static size_t
+per_line_scan(const char *data, size_t len) {
+    size_t pos = 0;
+    const char *cr;
+
+    while ((cr = memchr(data + pos, '\r', len - pos)) != NULL) {
+        pos = (size_t)(cr - data) + 2;
+        if (len - pos > 5 && strncasecmp("Host:", data + pos, 5) == 0)
+            return pos;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the offset of the Host header examining only candidate lines
+ */
+static size_t
+candidate_scan(size_t (*find_line)(const char *, size_t, char),
+        const char *data, size_t len) {
+    size_t pos = 0, next;
+
+    while ((next = find_line(data + pos, len - pos, 'H')) != (size_t)-1) {
+        pos += next;
+        if (len - pos > 5 && strncasecmp("Host:", data + pos, 5) == 0)
+            return pos;
+    }
+
+    return 0;
+}
+
+static double
+elapsed(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 +
+        (end->tv_nsec - start->tv_nsec);
+}
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <assert.h>
 #include "http.h"
+#include "http_scan.h"
 
 static const char *good[] = {
     "GET / HTTP/1.1\r\n"
@@ -20,6 +21,15 @@ static const char *good[] = {
         "HOST:\t     localhost:8080\r\n"
         "Accept: */*\r\n"
         "\r\n",
+    "GET /index.html HTTP/1.1\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.5\r\n"
+        "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark; hl=en\r\n"
+        "Cookie: tracking=fedcba9876543210fedcba9876543210fedcba9876543210\r\n"
+        "Connection: keep-alive\r\n"
+        "Host: localhost\r\n"
+        "\r\n",
 };
 static const char *bad[] = {
     "GET / HTTP/1.0\r\n"
@@ -40,6 +50,76 @@ static const char *bad[] = {
         "\r\n",
 };
 
+static void test_hostname_copy() {
+    struct ParseState state = { .offset = 0, .need = 0 };
+    char name[HOSTNAME_MAX_LEN + 1];
+    char request[HOSTNAME_MAX_LEN + 64];
+    int result;
+
+    /* hostnames are returned in lowercase */
+    snprintf(request, sizeof(request),
+            "GET / HTTP/1.1\r\nHost: WWW.Example.COM:80\r\n\r\n");
+    result = http_protocol->resume_parse(request, strlen(request), name, &state);
+    assert(result == 15);
+    assert(0 == strcmp("www.example.com", name));
+
+    /* longest hostname permitted */
+    state = (struct ParseState){ .offset = 0, .need = 0 };
+    snprintf(request, sizeof(request), "GET / HTTP/1.1\r\nHost: %0*d\r\n\r\n",
+            HOSTNAME_MAX_LEN, 0);
+    result = http_protocol->resume_parse(request, strlen(request), name, &state);
+    assert(result == HOSTNAME_MAX_LEN);
+
+    /* the port does not count towards the length of the hostname */
+    state = (struct ParseState){ .offset = 0, .need = 0 };
+    snprintf(request, sizeof(request),
+            "GET / HTTP/1.1\r\nHost: %0*d:65535\r\n\r\n", HOSTNAME_MAX_LEN, 0);
+    result = http_protocol->resume_parse(request, strlen(request), name, &state);
+    assert(result == HOSTNAME_MAX_LEN);
+
+    state = (struct ParseState){ .offset = 0, .need = 0 };
+    snprintf(request, sizeof(request), "GET / HTTP/1.1\r\nHost: %0*d\r\n\r\n",
+            HOSTNAME_MAX_LEN + 1, 0);
+    result = http_protocol->resume_parse(request, strlen(request), name, &state);
+    assert(result < -4);
+}
+
+/*
+ * Compare each http_find_line implementation with the scalar one on every
+ * substring of buffers built from the characters significant to the search
+ */
+static void test_find_line() {
+    static const char alphabet[] = "\r\nhHx";
+    char data[160];
+    unsigned int seed = 1;
+
+    for (int round = 0; round < 200; round++) {
+        for (size_t i = 0; i < sizeof(data); i++) {
+            seed = seed * 1103515245 + 12345;
+            data[i] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+        }
+
+        for (size_t start = 0; start < 8; start++)
+            for (size_t len = 0; start + len <= sizeof(data); len++) {
+                size_t expected = http_find_line_scalar(data + start, len, 'H');
+
+                assert(expected == http_find_line(data + start, len, 'H'));
+#ifdef HTTP_SCAN_X86
+                assert(expected == http_find_line_sse2(data + start, len, 'H'));
+                if (http_scan_avx2_supported())
+                    assert(expected ==
+                            http_find_line_avx2(data + start, len, 'H'));
+#endif
+            }
+    }
+
+    /* lines not preceded by <CR><LF> are not line starts */
+    assert(http_find_line("GET\r\nXy\r\nHost", 13, 'H') == 9);
+    assert(http_find_line("GET\nHost\rHost", 13, 'H') == (size_t)-1);
+    assert(http_find_line("GET\r\n\r\n", 7, 'H') == 5);
+    assert(http_find_line("GET\r\n", 5, 'H') == (size_t)-1);
+}
+
 int main() {
     unsigned int i;
     int result;
@@ -69,6 +149,34 @@ int main() {
         assert(hostname == NULL);
     }
 
+    /* request received one byte at a time */
+    for (i = 0; i < sizeof(good) / sizeof(const char *); i++) {
+        struct ParseState state = { .offset = 0, .need = 0 };
+        const char *host = strstr(good[i], "\r\nHost:");
+        if (host == NULL)
+            host = strstr(good[i], "\r\nHOST:");
+        assert(host != NULL);
+        size_t len, host_offset = (size_t)(host - good[i]) + 2;
+        char name[HOSTNAME_MAX_LEN + 1];
+
+        /* incomplete until the end of the Host header line */
+        for (len = 0; good[i][len] != '\0'; len++) {
+            result = http_protocol->resume_parse(good[i], len, name, &state);
+            if (result != -1)
+                break;
+
+            /* lines already examined are not examined again */
+            assert(state.offset <= host_offset);
+        }
+        assert(result == 9);
+        assert(state.offset == host_offset);
+        assert(0 == strcmp("localhost", name));
+    }
+
+    test_hostname_copy();
+
+    test_find_line();
+
     return 0;
 }
 
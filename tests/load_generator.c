@@ -0,0 +1,618 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "client_hello.h"
+
+/*
+ * Open many short lived connections through the proxy and report the
+ * connection rate, throughput and connection setup latency. Each connection
+ * sends an HTTP request or a TLS client hello for a hostname drawn from a
+ * uniform or Zipf distribution, then reads the response until the proxy
+ * closes the connection. Setup latency is measured from connect() to the
+ * first byte of the response, so it includes request parsing, the table
+ * lookup and the connection to the backend.
+ *
+ * With -b a sink backend is started on that local port, it answers each
+ * connection with a response of the size given by -s and closes it.
+ *
+ * Usage: load_generator [-c concurrency] [-n connections] [-p http|tls]
+ *                       [-k hostnames] [-z exponent] [-d domain]
+ *                       [-s response size] [-b backend port] host port
+ */
+
+#define MAX_EVENTS 256
+#define REQUEST_MAX_LEN 1024
+
+enum Protocol { PROTO_HTTP, PROTO_TLS };
+
+struct Client {
+    int fd;
+    enum { CONNECTING, SENDING, RECEIVING } state;
+    char request[REQUEST_MAX_LEN];
+    size_t request_len;
+    size_t sent;
+    size_t received;
+    struct timespec start;
+    double setup;       /* time to the first byte of the response, us */
+};
+
+struct Peer {
+    int fd;
+    int requested;      /* request received, response may be sent */
+    int shut;           /* response complete and write side shut down */
+    size_t sent;
+};
+
+struct Stats {
+    size_t started;
+    size_t completed;
+    size_t failed;
+    size_t bytes;
+    double *latencies;  /* setup latency of each completed connection, us */
+};
+
+static void usage(void);
+static void restart_client(int, struct Client *, const struct addrinfo *,
+        struct Stats *, size_t);
+static int start_client(int, struct Client *, const struct addrinfo *,
+        struct Stats *);
+static void client_event(int, struct Client *, uint32_t, struct Stats *);
+static void finish_client(struct Client *, int, struct Stats *);
+static size_t build_request(char *, size_t);
+static const char *pick_hostname(void);
+static void init_hostnames(size_t, double, const char *);
+static int listen_backend(uint16_t);
+static pid_t start_backend(int);
+static void run_backend(int);
+static void backend_event(int, struct Peer *, uint32_t);
+static int send_response(struct Peer *);
+static double percentile(const double *, size_t, double);
+static int compare_double(const void *, const void *);
+static double elapsed(const struct timespec *, const struct timespec *);
+
+static enum Protocol protocol = PROTO_HTTP;
+static char **hostnames;
+static double *hostname_cdf;
+static size_t hostnames_len;
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+static char response_header[128];
+static size_t response_header_len;
+static size_t response_len = 1024;
+static char scratch[65536];
+static char body[65536];
+
+
+int main(int argc, char **argv) {
+    size_t concurrency = 64;
+    size_t connections = 10000;
+    size_t names = 1;
+    double exponent = 0.0;
+    const char *domain = "example.com";
+    int backend_port = 0;
+    pid_t backend_pid = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:n:p:k:z:d:s:b:")) != -1) {
+        switch (opt) {
+            case 'c':
+                concurrency = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                connections = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                if (strcmp(optarg, "http") == 0)
+                    protocol = PROTO_HTTP;
+                else if (strcmp(optarg, "tls") == 0)
+                    protocol = PROTO_TLS;
+                else
+                    usage();
+                break;
+            case 'k':
+                names = strtoul(optarg, NULL, 10);
+                break;
+            case 'z':
+                exponent = strtod(optarg, NULL);
+                break;
+            case 'd':
+                domain = optarg;
+                break;
+            case 's':
+                response_len = strtoul(optarg, NULL, 10);
+                break;
+            case 'b':
+                backend_port = atoi(optarg);
+                break;
+            default:
+                usage();
+        }
+    }
+    if (argc - optind != 2 || concurrency == 0 || connections == 0 ||
+            names == 0 || backend_port < 0 || backend_port > 65535)
+        usage();
+
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *target;
+    int error = getaddrinfo(argv[optind], argv[optind + 1], &hints, &target);
+    if (error != 0) {
+        fprintf(stderr, "%s: %s\n", argv[optind], gai_strerror(error));
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    init_hostnames(names, exponent, domain);
+
+    if (backend_port != 0) {
+        int sockfd = listen_backend((uint16_t)backend_port);
+        if (sockfd < 0)
+            return 1;
+
+        backend_pid = start_backend(sockfd);
+        close(sockfd);
+        if (backend_pid < 0)
+            return 1;
+    }
+
+    struct Client *clients = calloc(concurrency, sizeof(struct Client));
+    struct Stats stats = {
+        .latencies = calloc(connections, sizeof(double)),
+    };
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (clients == NULL || stats.latencies == NULL || epfd < 0) {
+        perror("load_generator");
+        return 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; i < concurrency; i++) {
+        clients[i].fd = -1;
+        restart_client(epfd, &clients[i], target, &stats, connections);
+    }
+
+    while (stats.completed + stats.failed < stats.started) {
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            struct Client *client = events[i].data.ptr;
+
+            client_event(epfd, client, events[i].events, &stats);
+            restart_client(epfd, client, target, &stats, connections);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = elapsed(&start, &end) / 1e6;
+    qsort(stats.latencies, stats.completed, sizeof(double), compare_double);
+
+    printf("%zu connections completed, %zu failed in %.3f s\n",
+            stats.completed, stats.failed, seconds);
+    printf("rate:       %.1f connections/s\n", stats.completed / seconds);
+    printf("throughput: %.2f MB/s\n", stats.bytes / seconds / 1e6);
+    printf("setup latency: p50 %.0f us, p99 %.0f us, p999 %.0f us\n",
+            percentile(stats.latencies, stats.completed, 0.5),
+            percentile(stats.latencies, stats.completed, 0.99),
+            percentile(stats.latencies, stats.completed, 0.999));
+
+    if (backend_pid > 0) {
+        kill(backend_pid, SIGTERM);
+        waitpid(backend_pid, NULL, 0);
+    }
+
+    close(epfd);
+    free(clients);
+    free(stats.latencies);
+    freeaddrinfo(target);
+
+    return stats.failed == 0 ? 0 : 1;
+}
+
+static void
+usage(void) {
+    fprintf(stderr, "Usage: load_generator [-c concurrency] [-n connections] "
+            "[-p http|tls]\n"
+            "                      [-k hostnames] [-z exponent] [-d domain]\n"
+            "                      [-s response size] [-b backend port] "
+            "host port\n");
+    exit(2);
+}
+
+/*
+ * Start a new connection in place of a finished one, until the requested
+ * number of connections have been started
+ */
+static void
+restart_client(int epfd, struct Client *client, const struct addrinfo *target,
+        struct Stats *stats, size_t connections) {
+    while (client->fd < 0 && stats->started < connections)
+        if (start_client(epfd, client, target, stats) < 0)
+            break;
+}
+
+/*
+ * Returns -1 if no more connections can be started
+ */
+static int
+start_client(int epfd, struct Client *client, const struct addrinfo *target,
+        struct Stats *stats) {
+    client->fd = socket(target->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (client->fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    stats->started++;
+
+    client->state = CONNECTING;
+    client->request_len = build_request(client->request,
+            sizeof(client->request));
+    client->sent = 0;
+    client->received = 0;
+    clock_gettime(CLOCK_MONOTONIC, &client->start);
+
+    if (connect(client->fd, target->ai_addr, target->ai_addrlen) < 0 &&
+            errno != EINPROGRESS) {
+        finish_client(client, 0, stats);
+        return 0;
+    }
+
+    struct epoll_event event = { .events = EPOLLOUT, .data.ptr = client };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, client->fd, &event) < 0) {
+        perror("epoll_ctl");
+        finish_client(client, 0, stats);
+    }
+
+    return 0;
+}
+
+static void
+client_event(int epfd, struct Client *client, uint32_t events,
+        struct Stats *stats) {
+    if (client->state == CONNECTING) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+
+        if (getsockopt(client->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 ||
+                error != 0) {
+            finish_client(client, 0, stats);
+            return;
+        }
+        client->state = SENDING;
+    }
+
+    if (client->state == SENDING) {
+        while (client->sent < client->request_len) {
+            ssize_t n = send(client->fd, client->request + client->sent,
+                    client->request_len - client->sent, MSG_NOSIGNAL);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
+            if (n < 0) {
+                finish_client(client, 0, stats);
+                return;
+            }
+            client->sent += (size_t)n;
+        }
+
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = client };
+        epoll_ctl(epfd, EPOLL_CTL_MOD, client->fd, &event);
+        client->state = RECEIVING;
+        return;
+    }
+
+    if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+        return;
+
+    for (;;) {
+        ssize_t n = recv(client->fd, scratch, sizeof(scratch), 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0) {
+            /* the proxy closing without a response is a failure */
+            finish_client(client, n == 0 && client->received > 0, stats);
+            return;
+        }
+
+        if (client->received == 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            client->setup = elapsed(&client->start, &now);
+        }
+        client->received += (size_t)n;
+    }
+}
+
+static void
+finish_client(struct Client *client, int success, struct Stats *stats) {
+    close(client->fd); /* also removes it from the epoll set */
+    client->fd = -1;
+
+    if (success) {
+        stats->latencies[stats->completed++] = client->setup;
+        stats->bytes += client->received;
+    } else {
+        stats->failed++;
+    }
+}
+
+static size_t
+build_request(char *request, size_t len) {
+    const char *hostname = pick_hostname();
+
+    if (protocol == PROTO_TLS)
+        return client_hello((unsigned char *)request, len, hostname);
+
+    int n = snprintf(request, len,
+            "GET / HTTP/1.1\r\n"
+            "Host: %s\r\n"
+            "User-Agent: load_generator\r\n"
+            "Accept: */*\r\n"
+            "Connection: close\r\n"
+            "\r\n", hostname);
+
+    return n > 0 && (size_t)n < len ? (size_t)n : 0;
+}
+
+static const char *
+pick_hostname(void) {
+    /* xorshift64* */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    double u = (double)((rng_state * 0x2545f4914f6cdd1dULL) >> 11) /
+        (double)(1ULL << 53);
+
+    /* first hostname whose cumulative probability exceeds u */
+    size_t low = 0, high = hostnames_len - 1;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (hostname_cdf[mid] > u)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+
+    return hostnames[low];
+}
+
+/*
+ * Hostnames are host0.domain to host<count - 1>.domain, the i-th chosen with
+ * probability proportional to 1 / (i + 1)^exponent, so an exponent of 0 is a
+ * uniform distribution
+ */
+static void
+init_hostnames(size_t count, double exponent, const char *domain) {
+    double total = 0.0;
+
+    hostnames = calloc(count, sizeof(char *));
+    hostname_cdf = calloc(count, sizeof(double));
+    if (hostnames == NULL || hostname_cdf == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    hostnames_len = count;
+
+    for (size_t i = 0; i < count; i++) {
+        char name[256];
+        snprintf(name, sizeof(name), "host%zu.%s", i, domain);
+        hostnames[i] = strdup(name);
+        if (hostnames[i] == NULL) {
+            perror("strdup");
+            exit(1);
+        }
+
+        total += 1.0 / pow((double)(i + 1), exponent);
+        hostname_cdf[i] = total;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        hostname_cdf[i] /= total;
+    hostname_cdf[count - 1] = 1.0;
+}
+
+static int
+listen_backend(uint16_t port) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    int on = 1;
+
+    int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (sockfd < 0 ||
+            setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+            bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+            listen(sockfd, SOMAXCONN) < 0) {
+        perror("backend");
+        if (sockfd >= 0)
+            close(sockfd);
+        return -1;
+    }
+
+    return sockfd;
+}
+
+/*
+ * The backend runs in a child process so it does not compete with the
+ * clients for the event loop, the socket is already listening when this
+ * returns so connections can be made immediately
+ */
+static pid_t
+start_backend(int sockfd) {
+    if (protocol == PROTO_HTTP)
+        response_header_len = (size_t)snprintf(response_header,
+                sizeof(response_header),
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Length: %zu\r\n"
+                "Connection: close\r\n"
+                "\r\n", response_len);
+    memset(body, 'x', sizeof(body));
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+    } else if (pid == 0) {
+        run_backend(sockfd);
+        _exit(0);
+    }
+
+    return pid;
+}
+
+static void
+run_backend(int sockfd) {
+    struct Peer listener = { .fd = sockfd };
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = &listener };
+
+    if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd, &event) < 0) {
+        perror("backend");
+        return;
+    }
+
+    for (;;) {
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            return;
+        }
+
+        for (int i = 0; i < n; i++) {
+            struct Peer *peer = events[i].data.ptr;
+
+            if (peer != &listener) {
+                backend_event(epfd, peer, events[i].events);
+                continue;
+            }
+
+            int fd;
+            while ((fd = accept4(sockfd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+                peer = calloc(1, sizeof(struct Peer));
+                if (peer == NULL) {
+                    close(fd);
+                    continue;
+                }
+                peer->fd = fd;
+
+                event = (struct epoll_event){
+                    .events = EPOLLIN,
+                    .data.ptr = peer,
+                };
+                if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) < 0) {
+                    close(fd);
+                    free(peer);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * The response is sent once the request arrives and the write side shut
+ * down, the connection is closed when the proxy closes its side
+ */
+static void
+backend_event(int epfd, struct Peer *peer, uint32_t events) {
+    char request[4096];
+    ssize_t n;
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        while ((n = recv(peer->fd, request, sizeof(request), 0)) > 0)
+            peer->requested = 1;
+
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            close(peer->fd);
+            free(peer);
+            return;
+        }
+    }
+
+    if (peer->requested && !peer->shut) {
+        int result = send_response(peer);
+        struct epoll_event event = {
+            .events = EPOLLIN | (result == 0 ? EPOLLOUT : 0),
+            .data.ptr = peer,
+        };
+        epoll_ctl(epfd, EPOLL_CTL_MOD, peer->fd, &event);
+    }
+}
+
+/*
+ * Returns 0 while the response is incomplete
+ */
+static int
+send_response(struct Peer *peer) {
+    size_t total = response_header_len + response_len;
+
+    while (peer->sent < total) {
+        const char *data;
+        size_t len;
+
+        if (peer->sent < response_header_len) {
+            data = response_header + peer->sent;
+            len = response_header_len - peer->sent;
+        } else {
+            data = body;
+            len = total - peer->sent;
+            if (len > sizeof(body))
+                len = sizeof(body);
+        }
+
+        ssize_t n = send(peer->fd, data, len, MSG_NOSIGNAL);
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        peer->sent += (size_t)n;
+    }
+
+    shutdown(peer->fd, SHUT_WR);
+    peer->shut = 1;
+
+    return 1;
+}
+
+static double
+percentile(const double *sorted, size_t len, double q) {
+    if (len == 0)
+        return 0.0;
+
+    return sorted[(size_t)(q * (double)(len - 1))];
+}
+
+static int
+compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Returns the time between start and end in microseconds
+ */
+static double
+elapsed(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e6 +
+        (end->tv_nsec - start->tv_nsec) / 1e3;
+}
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "lookup_cache.h"
+#include "name_hash.h"
+#include "address.h"
+
+
+static void test_seed_name_hash();
+static void test_lookup_cache_put_get();
+static void test_lookup_cache_eviction();
+static void test_lookup_cache_validate();
+static void put_address(struct LookupCache *, const char *, const char *);
+
+
+int main() {
+    /* the remaining tests run with a seeded hash as sniproxy does */
+    test_seed_name_hash();
+    test_lookup_cache_put_get();
+    test_lookup_cache_eviction();
+    test_lookup_cache_validate();
+
+    return 0;
+}
+
+static void
+test_seed_name_hash() {
+    uint32_t unseeded = hash_name("example.com", 11);
+    assert(hash_name("example.com", 11) == unseeded);
+
+    seed_name_hash();
+
+    /* 1 in 2^32 chance of a false failure */
+    assert(hash_name("example.com", 11) != unseeded);
+    assert(hash_name("example.com", 11) == hash_name("example.com", 11));
+}
+
+static void
+put_address(struct LookupCache *cache, const char *name, const char *address) {
+    struct LookupResult result = {
+        .address = new_address(address),
+        .caller_free_address = 1,
+    };
+    assert(result.address != NULL);
+
+    const struct LookupResult *cached =
+        lookup_cache_put(cache, name, strlen(name), result);
+    assert(cached != NULL);
+    assert(cached->address == result.address);
+}
+
+static void
+test_lookup_cache_put_get() {
+    struct LookupCache *cache = new_lookup_cache(16);
+    assert(cache != NULL);
+    assert(lookup_cache_size(cache) == 16);
+
+    const char *name = "example.com";
+    assert(lookup_cache_get(cache, name, strlen(name)) == NULL);
+
+    put_address(cache, name, "192.0.2.10");
+
+    const struct LookupResult *cached =
+        lookup_cache_get(cache, name, strlen(name));
+    assert(cached != NULL);
+    assert(cached->address != NULL);
+    assert(address_is_sockaddr(cached->address));
+
+    /* names are compared by length, not as C strings */
+    assert(lookup_cache_get(cache, name, strlen(name) - 1) == NULL);
+
+    /* negative results are cached too */
+    const char *unknown = "unknown.example.com";
+    struct LookupResult result = {.address = NULL};
+    cached = lookup_cache_put(cache, unknown, strlen(unknown), result);
+    assert(cached != NULL);
+    cached = lookup_cache_get(cache, unknown, strlen(unknown));
+    assert(cached != NULL);
+    assert(cached->address == NULL);
+
+    /* replace an existing entry */
+    put_address(cache, name, "192.0.2.11");
+    cached = lookup_cache_get(cache, name, strlen(name));
+    assert(cached != NULL);
+    struct Address *expected = new_address("192.0.2.11");
+    assert(address_compare(cached->address, expected) == 0);
+    free(expected);
+
+    free_lookup_cache(cache);
+}
+
+static void
+test_lookup_cache_eviction() {
+    struct LookupCache *cache = new_lookup_cache(3);
+    assert(cache != NULL);
+
+    put_address(cache, "a.example.com", "192.0.2.1");
+    put_address(cache, "b.example.com", "192.0.2.2");
+    put_address(cache, "c.example.com", "192.0.2.3");
+
+    /* a becomes the most recently used */
+    assert(lookup_cache_get(cache, "a.example.com", 13) != NULL);
+
+    /* evicts b */
+    put_address(cache, "d.example.com", "192.0.2.4");
+    assert(lookup_cache_get(cache, "b.example.com", 13) == NULL);
+    assert(lookup_cache_get(cache, "a.example.com", 13) != NULL);
+    assert(lookup_cache_get(cache, "c.example.com", 13) != NULL);
+    assert(lookup_cache_get(cache, "d.example.com", 13) != NULL);
+
+    free_lookup_cache(cache);
+
+    /* a zero sized cache stores nothing */
+    cache = new_lookup_cache(0);
+    assert(cache != NULL);
+    struct LookupResult result = {
+        .address = new_address("192.0.2.1"),
+        .caller_free_address = 1,
+    };
+    assert(lookup_cache_put(cache, "a.example.com", 13, result) == NULL);
+    assert(lookup_cache_get(cache, "a.example.com", 13) == NULL);
+    free_lookup_cache(cache);
+}
+
+static void
+test_lookup_cache_validate() {
+    struct LookupCache *cache = new_lookup_cache(16);
+    assert(cache != NULL);
+
+    lookup_cache_validate(cache, 1);
+    put_address(cache, "example.com", "192.0.2.10");
+
+    lookup_cache_validate(cache, 1);
+    assert(lookup_cache_get(cache, "example.com", 11) != NULL);
+
+    lookup_cache_validate(cache, 2);
+    assert(lookup_cache_get(cache, "example.com", 11) == NULL);
+
+    put_address(cache, "example.com", "192.0.2.10");
+    lookup_cache_flush(cache);
+    assert(lookup_cache_get(cache, "example.com", 11) == NULL);
+
+    free_lookup_cache(cache);
+}
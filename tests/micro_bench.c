@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <ev.h>
+#include "address.h"
+#include "backend.h"
+#include "buffer.h"
+#include "http.h"
+#include "logger.h"
+#include "table.h"
+#include "tls.h"
+#include "client_hello.h"
+
+/*
+ * Time the per connection hot paths in isolation: request parsing, buffer
+ * operations, table lookups and address parsing. Each benchmark reports the
+ * mean time and the number of heap allocations per operation, so changes can
+ * be compared on the same machine without running the whole proxy.
+ *
+ * Usage: micro_bench [iterations] [name prefix]
+ */
+
+struct Measurement {
+    const char *name;
+    size_t ops;
+    size_t allocations;
+    struct timespec start;
+};
+
+static void bench_parsers(size_t);
+static void bench_buffers(size_t);
+static void bench_lookups(size_t);
+static void bench_addresses(size_t);
+static void bench_buffer(const char *, struct Buffer *, size_t);
+static struct Table *new_bench_table(size_t, int);
+static int selected(const char *);
+static void begin(struct Measurement *, const char *, size_t);
+static void end(const struct Measurement *);
+
+static const char *filter;
+static volatile size_t sink;
+
+/*
+ * Count heap allocations by interposing the allocator, this is only possible
+ * with glibc which exports its implementation under a second name
+ */
+#ifdef __GLIBC__
+#define COUNT_ALLOCATIONS
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+static size_t allocations;
+
+void *
+malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size) {
+    allocations++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size) {
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+static const char http_request[] =
+    "GET /assets/app.js HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+    "Accept: */*\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Referer: https://www.example.com/\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+
+int main(int argc, char **argv) {
+    size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    filter = argc > 2 ? argv[2] : NULL;
+
+    struct Logger *logger = new_file_logger("/dev/stderr");
+    assert(logger != NULL);
+    set_logger_priority(logger, LOG_WARNING);
+    set_default_logger(logger);
+
+#ifndef COUNT_ALLOCATIONS
+    printf("allocation counting is not supported on this platform\n");
+#endif
+
+    bench_parsers(iterations);
+    bench_buffers(iterations);
+    bench_lookups(iterations);
+    bench_addresses(iterations);
+
+    free_buffer_pools();
+    free_backend_jit_stack();
+
+    return 0;
+}
+
+static void
+bench_parsers(size_t iterations) {
+    struct Measurement m;
+    unsigned char hello[CLIENT_HELLO_LEN];
+    size_t hello_len = client_hello(hello, sizeof(hello),
+            "www.example.com");
+    char hostname[HOSTNAME_MAX_LEN + 1];
+    assert(hello_len == sizeof(hello));
+
+    if (selected("tls parse_packet")) {
+        begin(&m, "tls parse_packet", iterations);
+        for (size_t i = 0; i < iterations; i++) {
+            char *name = NULL;
+            int result = tls_protocol->parse_packet((const char *)hello,
+                    hello_len, &name);
+            assert(result == 15);
+            free(name);
+        }
+        end(&m);
+    }
+
+    if (selected("tls resume_parse")) {
+        begin(&m, "tls resume_parse", iterations);
+        for (size_t i = 0; i < iterations; i++) {
+            struct ParseState state = { .offset = 0, .need = 0 };
+            int result = tls_protocol->resume_parse((const char *)hello,
+                    hello_len, hostname, &state);
+            assert(result == 15);
+        }
+        end(&m);
+    }
+
+    if (selected("http parse_packet")) {
+        begin(&m, "http parse_packet", iterations);
+        for (size_t i = 0; i < iterations; i++) {
+            char *name = NULL;
+            int result = http_protocol->parse_packet(http_request,
+                    sizeof(http_request) - 1, &name);
+            assert(result == 15);
+            free(name);
+        }
+        end(&m);
+    }
+
+    if (selected("http resume_parse")) {
+        begin(&m, "http resume_parse", iterations);
+        for (size_t i = 0; i < iterations; i++) {
+            struct ParseState state = { .offset = 0, .need = 0 };
+            int result = http_protocol->resume_parse(http_request,
+                    sizeof(http_request) - 1, hostname, &state);
+            assert(result == 15);
+        }
+        end(&m);
+    }
+}
+
+static void
+bench_buffers(size_t iterations) {
+    struct Buffer *buffer = new_buffer(16384, EV_DEFAULT);
+    assert(buffer != NULL);
+    bench_buffer("buffer", buffer, iterations);
+    free_buffer(buffer);
+
+    buffer = new_mirrored_buffer(16384, EV_DEFAULT);
+    assert(buffer != NULL);
+    bench_buffer(buffer->mirrored ? "mirrored buffer" : "mirrored fallback",
+            buffer, iterations);
+    free_buffer(buffer);
+}
+
+/*
+ * Segments of a typical MTU sized read are pushed and popped, so the buffer
+ * contents wrap around the end of the storage regularly
+ */
+static void
+bench_buffer(const char *prefix, struct Buffer *buffer, size_t iterations) {
+    char segment[1448], scratch[1448];
+    char name[64];
+    struct Measurement m;
+
+    memset(segment, 'x', sizeof(segment));
+
+    snprintf(name, sizeof(name), "%s push/pop", prefix);
+    if (selected(name)) {
+        begin(&m, name, iterations);
+        for (size_t i = 0; i < iterations; i++) {
+            sink = buffer_push(buffer, segment, sizeof(segment));
+            sink = buffer_pop(buffer, segment, sizeof(segment));
+        }
+        end(&m);
+    }
+
+    /* leave the contents split across the end of the storage */
+    snprintf(name, sizeof(name), "%s push/coalesce", prefix);
+    if (selected(name)) {
+        begin(&m, name, iterations);
+        for (size_t i = 0; i < iterations; i++) {
+            const void *data;
+
+            buffer_push(buffer, segment, sizeof(segment));
+            sink = buffer_coalesce(buffer, &data);
+            buffer_pop(buffer, scratch, sizeof(segment) / 2);
+            buffer_push(buffer, segment, sizeof(segment) / 2);
+            buffer_pop(buffer, scratch, sizeof(segment));
+        }
+        end(&m);
+    }
+}
+
+static void
+bench_lookups(size_t iterations) {
+    static const size_t sizes[] = { 10, 1000, 100000 };
+    char name[64], hostname[64];
+    struct Measurement m;
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t entries = sizes[s];
+
+        for (int regex = 0; regex <= 1; regex++) {
+            /* regular expressions are evaluated in turn, keep the run short */
+            size_t ops = regex && entries > 1000 ?
+                iterations / 10000 + 1 : iterations;
+
+            snprintf(name, sizeof(name), "lookup_backend %s %zu",
+                    regex ? "regex" : "literal", entries);
+            if (!selected(name))
+                continue;
+
+            struct Table *table = new_bench_table(entries, regex);
+
+            begin(&m, name, ops);
+            for (size_t i = 0; i < ops; i++) {
+                int len = snprintf(hostname, sizeof(hostname),
+                        "host%zu.example.com", (i * 7919) % entries);
+                struct Backend *backend = lookup_backend_index(
+                        table->backend_index, hostname, (size_t)len, NULL, 0);
+                assert(backend != NULL);
+            }
+            end(&m);
+
+            table_ref_put(table);
+        }
+    }
+}
+
+static void
+bench_addresses(size_t iterations) {
+    static const char *addresses[] = {
+        "192.0.2.10",
+        "192.0.2.10:443",
+        "[2001:db8::10]:443",
+        "www.example.com:443",
+        "unix:/var/run/backend.sock",
+    };
+    char name[64];
+    struct Measurement m;
+
+    for (size_t a = 0; a < sizeof(addresses) / sizeof(addresses[0]); a++) {
+        snprintf(name, sizeof(name), "new_address %s", addresses[a]);
+        if (!selected(name))
+            continue;
+
+        begin(&m, name, iterations);
+        for (size_t i = 0; i < iterations; i++) {
+            struct Address *address = new_address(addresses[a]);
+            assert(address != NULL);
+            free(address);
+        }
+        end(&m);
+    }
+}
+
+/*
+ * Literal patterns are indexed by hostname, patterns with an alternation
+ * can not be and are evaluated as regular expressions
+ */
+static struct Table *
+new_bench_table(size_t entries, int regex) {
+    struct Table *table = new_table();
+    assert(table != NULL);
+    table_ref_get(table);
+
+    for (size_t i = 0; i < entries; i++) {
+        char pattern[64];
+        struct Backend *backend = new_backend();
+        assert(backend != NULL);
+
+        snprintf(pattern, sizeof(pattern),
+                regex ? "^(www\\.)?host%zu\\.example\\.(com|net)$" :
+                        "^host%zu\\.example\\.com$", i);
+        assert(accept_backend_arg(backend, pattern) == 1);
+        assert(accept_backend_arg(backend, "192.0.2.10") == 1);
+        add_backend(&table->backends, backend);
+    }
+
+    init_table(table);
+
+    return table;
+}
+
+/*
+ * Returns 0 if the benchmark is excluded by the name prefix filter
+ */
+static int
+selected(const char *name) {
+    return filter == NULL || strncmp(filter, name, strlen(filter)) == 0;
+}
+
+static void
+begin(struct Measurement *m, const char *name, size_t ops) {
+    m->name = name;
+    m->ops = ops;
+#ifdef COUNT_ALLOCATIONS
+    m->allocations = allocations;
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &m->start);
+}
+
+static void
+end(const struct Measurement *m) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    double ns = (now.tv_sec - m->start.tv_sec) * 1e9 +
+        (now.tv_nsec - m->start.tv_nsec);
+#ifdef COUNT_ALLOCATIONS
+    printf("%-40s %10.1f ns/op %8.2f allocs/op\n", m->name, ns / m->ops,
+            (double)(allocations - m->allocations) / m->ops);
+#else
+    printf("%-40s %10.1f ns/op\n", m->name, ns / m->ops);
+#endif
+}
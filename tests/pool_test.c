@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "pool.h"
+
+
+static void test_pool_reuse();
+static void test_pool_max_free();
+
+
+int main() {
+    test_pool_reuse();
+    test_pool_max_free();
+
+    return 0;
+}
+
+static void
+test_pool_reuse() {
+    struct Pool pool = POOL_INITIALIZER("test", 64, 4);
+
+    char *a = pool_alloc(&pool);
+    char *b = pool_alloc(&pool);
+    assert(a != NULL && b != NULL && a != b);
+    memset(a, 'a', 64);
+    memset(b, 'b', 64);
+    assert(pool.in_use == 2);
+    assert(pool.allocated == 2);
+
+    pool_free(&pool, a);
+    assert(pool.in_use == 1);
+    assert(pool.free_len == 1);
+
+    /* released objects are reused */
+    char *c = pool_alloc(&pool);
+    assert(c == a);
+    assert(pool.reused == 1);
+    assert(pool.allocated == 2);
+    assert(pool.peak_in_use == 2);
+
+    pool_free(&pool, NULL);
+    pool_free(&pool, b);
+    pool_free(&pool, c);
+    assert(pool.in_use == 0);
+    assert(pool.free_len == 2);
+
+    print_pool_stats(stdout, &pool);
+
+    pool_trim(&pool);
+    assert(pool.free_len == 0);
+    assert(pool.free_list == NULL);
+}
+
+static void
+test_pool_max_free() {
+    struct Pool pool = POOL_INITIALIZER("test", 32, 2);
+    void *objects[4];
+
+    for (size_t i = 0; i < 4; i++) {
+        objects[i] = pool_alloc(&pool);
+        assert(objects[i] != NULL);
+    }
+
+    for (size_t i = 0; i < 4; i++)
+        pool_free(&pool, objects[i]);
+
+    /* objects beyond max_free are returned to the system */
+    assert(pool.free_len == 2);
+    assert(pool.in_use == 0);
+    assert(pool.peak_in_use == 4);
+
+    pool_trim(&pool);
+}
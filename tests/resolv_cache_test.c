@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "resolv_cache.h"
+#include "name_hash.h"
+#include "resolv.h"
+#include "address.h"
+
+
+static void test_resolv_cache_put_get();
+static void test_resolv_cache_ttl();
+static void test_resolv_cache_eviction();
+static void test_resolv_cache_negative();
+static void test_resolv_cache_stale();
+static void put_address(struct ResolvCache *, const char *, int,
+        const char *, unsigned int, ev_tstamp);
+
+
+int main() {
+    /* hostnames are hashed with a per process seed as in sniproxy */
+    seed_name_hash();
+
+    test_resolv_cache_put_get();
+    test_resolv_cache_ttl();
+    test_resolv_cache_eviction();
+    test_resolv_cache_negative();
+    test_resolv_cache_stale();
+
+    return 0;
+}
+
+static void
+put_address(struct ResolvCache *cache, const char *hostname, int mode,
+        const char *address, unsigned int ttl, ev_tstamp now) {
+    struct Address *response = new_address(address);
+    assert(response != NULL);
+
+    assert(resolv_cache_put(cache, hostname, mode, &response, 1, ttl, now) == 1);
+
+    /* the cache keeps its own copy */
+    free(response);
+}
+
+static void
+test_resolv_cache_put_get() {
+    struct ResolvCache *cache = new_resolv_cache(16, 0, 3600, 0, 0);
+    struct Address *const *addresses;
+    size_t count;
+    char buffer[ADDRESS_BUFFER_SIZE];
+    assert(cache != NULL);
+
+    assert(resolv_cache_get(cache, "example.com", RESOLV_MODE_IPV4_ONLY, 0.0,
+                &addresses, &count) == 0);
+
+    struct Address *responses[] = {
+        new_address("192.0.2.10"),
+        new_address("[2001:db8::10]"),
+    };
+    assert(responses[0] != NULL && responses[1] != NULL);
+    assert(resolv_cache_put(cache, "example.com", RESOLV_MODE_IPV4_FIRST,
+                responses, 2, 300, 0.0) == 1);
+    free(responses[0]);
+    free(responses[1]);
+
+    assert(resolv_cache_get(cache, "example.com", RESOLV_MODE_IPV4_FIRST, 1.0,
+                &addresses, &count) == 1);
+    assert(count == 2);
+    assert(strcmp(display_address(addresses[0], buffer, sizeof(buffer)),
+                "192.0.2.10") == 0);
+    assert(strcmp(display_address(addresses[1], buffer, sizeof(buffer)),
+                "[2001:db8::10]") == 0);
+
+    /* entries are keyed by resolver mode as well as hostname */
+    assert(resolv_cache_get(cache, "example.com", RESOLV_MODE_IPV6_FIRST, 1.0,
+                &addresses, &count) == 0);
+    assert(resolv_cache_get(cache, "example.co", RESOLV_MODE_IPV4_FIRST, 1.0,
+                &addresses, &count) == 0);
+
+    /* replacing an entry */
+    put_address(cache, "example.com", RESOLV_MODE_IPV4_FIRST, "192.0.2.11",
+            300, 2.0);
+    assert(resolv_cache_len(cache) == 1);
+    assert(resolv_cache_get(cache, "example.com", RESOLV_MODE_IPV4_FIRST, 3.0,
+                &addresses, &count) == 1);
+    assert(count == 1);
+    assert(strcmp(display_address(addresses[0], buffer, sizeof(buffer)),
+                "192.0.2.11") == 0);
+
+    resolv_cache_flush(cache);
+    assert(resolv_cache_len(cache) == 0);
+
+    free_resolv_cache(cache);
+}
+
+static void
+test_resolv_cache_ttl() {
+    struct ResolvCache *cache = new_resolv_cache(16, 10, 60, 0, 0);
+    struct Address *const *addresses;
+    size_t count;
+    assert(cache != NULL);
+
+    /* TTLs below the minimum are raised */
+    put_address(cache, "short.example.com", RESOLV_MODE_IPV4_ONLY,
+            "192.0.2.1", 1, 100.0);
+    assert(resolv_cache_get(cache, "short.example.com", RESOLV_MODE_IPV4_ONLY,
+                109.0, &addresses, &count) == 1);
+    assert(resolv_cache_get(cache, "short.example.com", RESOLV_MODE_IPV4_ONLY,
+                110.0, &addresses, &count) == 0);
+
+    /* expired entries are removed */
+    assert(resolv_cache_len(cache) == 0);
+
+    /* TTLs above the maximum are lowered */
+    put_address(cache, "long.example.com", RESOLV_MODE_IPV4_ONLY,
+            "192.0.2.2", 86400, 100.0);
+    assert(resolv_cache_get(cache, "long.example.com", RESOLV_MODE_IPV4_ONLY,
+                159.0, &addresses, &count) == 1);
+    assert(resolv_cache_get(cache, "long.example.com", RESOLV_MODE_IPV4_ONLY,
+                160.0, &addresses, &count) == 0);
+
+    free_resolv_cache(cache);
+
+    /* a zero TTL is not cached */
+    cache = new_resolv_cache(16, 0, 60, 0, 0);
+    assert(cache != NULL);
+    struct Address *response = new_address("192.0.2.3");
+    assert(response != NULL);
+    assert(resolv_cache_put(cache, "zero.example.com", RESOLV_MODE_IPV4_ONLY,
+                &response, 1, 0, 100.0) == 0);
+    assert(resolv_cache_len(cache) == 0);
+    free(response);
+
+    free_resolv_cache(cache);
+}
+
+static void
+test_resolv_cache_eviction() {
+    struct ResolvCache *cache = new_resolv_cache(2, 0, 3600, 0, 0);
+    struct Address *const *addresses;
+    size_t count;
+    assert(cache != NULL);
+
+    put_address(cache, "a.example.com", RESOLV_MODE_IPV4_ONLY,
+            "192.0.2.1", 300, 0.0);
+    put_address(cache, "b.example.com", RESOLV_MODE_IPV4_ONLY,
+            "192.0.2.2", 300, 0.0);
+
+    /* touch a so b is the least recently used */
+    assert(resolv_cache_get(cache, "a.example.com", RESOLV_MODE_IPV4_ONLY, 1.0,
+                &addresses, &count) == 1);
+
+    put_address(cache, "c.example.com", RESOLV_MODE_IPV4_ONLY,
+            "192.0.2.3", 300, 1.0);
+    assert(resolv_cache_len(cache) == 2);
+
+    assert(resolv_cache_get(cache, "a.example.com", RESOLV_MODE_IPV4_ONLY, 1.0,
+                &addresses, &count) == 1);
+    assert(resolv_cache_get(cache, "b.example.com", RESOLV_MODE_IPV4_ONLY, 1.0,
+                &addresses, &count) == 0);
+    assert(resolv_cache_get(cache, "c.example.com", RESOLV_MODE_IPV4_ONLY, 1.0,
+                &addresses, &count) == 1);
+
+    free_resolv_cache(cache);
+
+    /* a zero size disables the cache */
+    cache = new_resolv_cache(0, 0, 3600, 0, 0);
+    assert(cache != NULL);
+    struct Address *response = new_address("192.0.2.4");
+    assert(response != NULL);
+    assert(resolv_cache_put(cache, "d.example.com", RESOLV_MODE_IPV4_ONLY,
+                &response, 1, 300, 0.0) == 0);
+    free(response);
+
+    free_resolv_cache(cache);
+}
+
+static void
+test_resolv_cache_negative() {
+    struct ResolvCache *cache = new_resolv_cache(16, 30, 3600, 5, 60);
+    struct Address *const *addresses;
+    size_t count;
+    assert(cache != NULL);
+
+    /* failures use the negative TTL regardless of the minimum TTL */
+    assert(resolv_cache_put(cache, "nx.example.com", RESOLV_MODE_IPV4_ONLY,
+                NULL, 0, 0, 100.0) == 1);
+    assert(resolv_cache_get(cache, "nx.example.com", RESOLV_MODE_IPV4_ONLY,
+                104.0, &addresses, &count) == RESOLV_CACHE_HIT);
+    assert(count == 0);
+
+    /* and are never returned stale */
+    assert(resolv_cache_get(cache, "nx.example.com", RESOLV_MODE_IPV4_ONLY,
+                105.0, &addresses, &count) == RESOLV_CACHE_MISS);
+    assert(resolv_cache_len(cache) == 0);
+
+    free_resolv_cache(cache);
+
+    /* a zero negative TTL disables negative caching */
+    cache = new_resolv_cache(16, 0, 3600, 0, 0);
+    assert(cache != NULL);
+    assert(resolv_cache_put(cache, "nx.example.com", RESOLV_MODE_IPV4_ONLY,
+                NULL, 0, 0, 100.0) == 0);
+    assert(resolv_cache_len(cache) == 0);
+
+    free_resolv_cache(cache);
+}
+
+static void
+test_resolv_cache_stale() {
+    struct ResolvCache *cache = new_resolv_cache(16, 0, 3600, 0, 30);
+    struct Address *const *addresses;
+    size_t count;
+    char buffer[ADDRESS_BUFFER_SIZE];
+    assert(cache != NULL);
+
+    put_address(cache, "example.com", RESOLV_MODE_IPV4_ONLY,
+            "192.0.2.1", 10, 100.0);
+    assert(resolv_cache_get(cache, "example.com", RESOLV_MODE_IPV4_ONLY,
+                109.0, &addresses, &count) == RESOLV_CACHE_HIT);
+
+    /* expired entries are stale until the stale TTL runs out */
+    assert(resolv_cache_get(cache, "example.com", RESOLV_MODE_IPV4_ONLY,
+                110.0, &addresses, &count) == RESOLV_CACHE_STALE);
+    assert(count == 1);
+    assert(strcmp(display_address(addresses[0], buffer, sizeof(buffer)),
+                "192.0.2.1") == 0);
+    assert(resolv_cache_get(cache, "example.com", RESOLV_MODE_IPV4_ONLY,
+                139.0, &addresses, &count) == RESOLV_CACHE_STALE);
+    assert(resolv_cache_get(cache, "example.com", RESOLV_MODE_IPV4_ONLY,
+                140.0, &addresses, &count) == RESOLV_CACHE_MISS);
+    assert(resolv_cache_len(cache) == 0);
+
+    /* refreshing a stale entry */
+    put_address(cache, "example.com", RESOLV_MODE_IPV4_ONLY,
+            "192.0.2.1", 10, 200.0);
+    assert(resolv_cache_get(cache, "example.com", RESOLV_MODE_IPV4_ONLY,
+                215.0, &addresses, &count) == RESOLV_CACHE_STALE);
+    put_address(cache, "example.com", RESOLV_MODE_IPV4_ONLY,
+            "192.0.2.2", 10, 215.0);
+    assert(resolv_cache_get(cache, "example.com", RESOLV_MODE_IPV4_ONLY,
+                216.0, &addresses, &count) == RESOLV_CACHE_HIT);
+    assert(strcmp(display_address(addresses[0], buffer, sizeof(buffer)),
+                "192.0.2.2") == 0);
+
+    free_resolv_cache(cache);
+}
@@ -0,0 +1,497 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <ev.h>
+#include <udns.h>
+#include "resolv.h"
+#include "resolv_cache.h"
+#include "address.h"
+
+/*
+ * Stub udns context: queries are recorded instead of sent so each test can
+ * complete or inspect them in the order it chooses.
+ */
+#define MAX_STUB_QUERIES 32
+
+struct dns_ctx {
+    int unused;
+};
+
+struct dns_query {
+    size_t index;
+};
+
+struct StubQuery {
+    char hostname[256];
+    int is_a6;
+    dns_query_a4_fn *a4_cb;
+    dns_query_a6_fn *a6_cb;
+    void *data;
+    struct dns_query *handle;
+    int cancelled;
+    int completed;
+};
+
+struct dns_ctx dns_defctx;
+static struct StubQuery stub_queries[MAX_STUB_QUERIES];
+static size_t stub_query_count = 0;
+static int stub_sockfd = -1;
+
+struct Client {
+    struct ResolvQuery *handle;
+    int callbacks;
+    int freed;
+    char address[ADDRESS_BUFFER_SIZE];
+    /* resolve this hostname again from the callback */
+    const char *requery;
+    struct Client *next;
+};
+
+
+static void test_coalesce_waiters();
+static void test_modes_not_coalesced();
+static void test_cancel_one_waiter();
+static void test_cancel_last_waiter();
+static void test_requery_from_callback();
+static void test_attach_to_refresh();
+static void setup(struct ResolvCache *);
+static void teardown();
+static void query(struct Client *, const char *, int);
+static void complete_a4(size_t, const char *, unsigned int);
+static void complete_a6(size_t, const char *, unsigned int);
+static size_t active_queries();
+
+
+int main() {
+    test_coalesce_waiters();
+    test_modes_not_coalesced();
+    test_cancel_one_waiter();
+    test_cancel_last_waiter();
+    test_requery_from_callback();
+    test_attach_to_refresh();
+
+    return 0;
+}
+
+int
+dns_init(struct dns_ctx *ctx __attribute__((unused)),
+        int do_open __attribute__((unused))) {
+    return 0;
+}
+
+int
+dns_reset(struct dns_ctx *ctx __attribute__((unused))) {
+    return 0;
+}
+
+int
+dns_add_serv(struct dns_ctx *ctx __attribute__((unused)),
+        const char *serv __attribute__((unused))) {
+    return 0;
+}
+
+int
+dns_add_srch(struct dns_ctx *ctx __attribute__((unused)),
+        const char *srch __attribute__((unused))) {
+    return 0;
+}
+
+int
+dns_open(struct dns_ctx *ctx __attribute__((unused))) {
+    stub_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    return stub_sockfd;
+}
+
+void
+dns_close(struct dns_ctx *ctx __attribute__((unused))) {
+    close(stub_sockfd);
+    stub_sockfd = -1;
+}
+
+struct dns_ctx *
+dns_new(const struct dns_ctx *copy __attribute__((unused))) {
+    return NULL;
+}
+
+void
+dns_free(struct dns_ctx *ctx __attribute__((unused))) {
+}
+
+int
+dns_status(const struct dns_ctx *ctx __attribute__((unused))) {
+    return DNS_E_NXDOMAIN;
+}
+
+const char *
+dns_strerror(int error __attribute__((unused))) {
+    return "stub error";
+}
+
+void
+dns_ioevent(struct dns_ctx *ctx __attribute__((unused)),
+        time_t now __attribute__((unused))) {
+}
+
+int
+dns_timeouts(struct dns_ctx *ctx __attribute__((unused)),
+        int maxwait __attribute__((unused)),
+        time_t now __attribute__((unused))) {
+    return -1;
+}
+
+void
+dns_set_tmcbck(struct dns_ctx *ctx __attribute__((unused)),
+        dns_utm_fn *fn __attribute__((unused)),
+        void *data __attribute__((unused))) {
+}
+
+int
+dns_cancel(struct dns_ctx *ctx __attribute__((unused)),
+        struct dns_query *q) {
+    assert(q->index < stub_query_count);
+    assert(!stub_queries[q->index].completed);
+
+    stub_queries[q->index].cancelled = 1;
+    stub_queries[q->index].handle = NULL; /* freed by the caller */
+
+    return 0;
+}
+
+static struct dns_query *
+stub_submit(const char *name, int is_a6, dns_query_a4_fn *a4_cb,
+        dns_query_a6_fn *a6_cb, void *data) {
+    assert(stub_query_count < MAX_STUB_QUERIES);
+    struct StubQuery *stub = &stub_queries[stub_query_count];
+
+    memset(stub, 0, sizeof(*stub));
+    strncpy(stub->hostname, name, sizeof(stub->hostname) - 1);
+    stub->is_a6 = is_a6;
+    stub->a4_cb = a4_cb;
+    stub->a6_cb = a6_cb;
+    stub->data = data;
+    stub->handle = malloc(sizeof(struct dns_query));
+    assert(stub->handle != NULL);
+    stub->handle->index = stub_query_count++;
+
+    return stub->handle;
+}
+
+struct dns_query *
+dns_submit_a4(struct dns_ctx *ctx __attribute__((unused)), const char *name,
+        int flags __attribute__((unused)), dns_query_a4_fn *cb, void *data) {
+    return stub_submit(name, 0, cb, NULL, data);
+}
+
+struct dns_query *
+dns_submit_a6(struct dns_ctx *ctx __attribute__((unused)), const char *name,
+        int flags __attribute__((unused)), dns_query_a6_fn *cb, void *data) {
+    return stub_submit(name, 1, NULL, cb, data);
+}
+
+/* Deliver an A response, or a failure when address is NULL */
+static void
+complete_a4(size_t index, const char *address, unsigned int ttl) {
+    struct StubQuery *stub = &stub_queries[index];
+    struct dns_rr_a4 *result = NULL;
+
+    assert(index < stub_query_count);
+    assert(!stub->is_a6 && !stub->cancelled && !stub->completed);
+
+    if (address != NULL) {
+        result = calloc(1, sizeof(struct dns_rr_a4) + sizeof(struct in_addr));
+        assert(result != NULL);
+        result->dnsa4_ttl = ttl;
+        result->dnsa4_nrr = 1;
+        result->dnsa4_addr = (struct in_addr *)(result + 1);
+        assert(inet_pton(AF_INET, address, result->dnsa4_addr) == 1);
+    }
+
+    stub->completed = 1;
+    free(stub->handle);
+    stub->handle = NULL;
+
+    stub->a4_cb(&dns_defctx, result, stub->data);
+}
+
+static void
+complete_a6(size_t index, const char *address, unsigned int ttl) {
+    struct StubQuery *stub = &stub_queries[index];
+    struct dns_rr_a6 *result = NULL;
+
+    assert(index < stub_query_count);
+    assert(stub->is_a6 && !stub->cancelled && !stub->completed);
+
+    if (address != NULL) {
+        result = calloc(1, sizeof(struct dns_rr_a6) + sizeof(struct in6_addr));
+        assert(result != NULL);
+        result->dnsa6_ttl = ttl;
+        result->dnsa6_nrr = 1;
+        result->dnsa6_addr = (struct in6_addr *)(result + 1);
+        assert(inet_pton(AF_INET6, address, result->dnsa6_addr) == 1);
+    }
+
+    stub->completed = 1;
+    free(stub->handle);
+    stub->handle = NULL;
+
+    stub->a6_cb(&dns_defctx, result, stub->data);
+}
+
+static size_t
+active_queries() {
+    size_t count = 0;
+
+    for (size_t i = 0; i < stub_query_count; i++)
+        if (!stub_queries[i].cancelled && !stub_queries[i].completed)
+            count++;
+
+    return count;
+}
+
+static void
+client_cb(struct Address *result, void *data) {
+    struct Client *client = (struct Client *)data;
+
+    client->callbacks++;
+    client->handle = NULL;
+    if (result == NULL)
+        client->address[0] = '\0';
+    else
+        display_address(result, client->address, sizeof(client->address));
+
+    if (client->requery != NULL && client->next != NULL)
+        query(client->next, client->requery, RESOLV_MODE_IPV4_ONLY);
+}
+
+static void
+client_free_cb(void *data) {
+    struct Client *client = (struct Client *)data;
+
+    client->freed++;
+}
+
+static void
+query(struct Client *client, const char *hostname, int mode) {
+    client->handle = resolv_query(hostname, mode, client_cb, client_free_cb,
+            client);
+    assert(client->handle != NULL);
+}
+
+static void
+setup(struct ResolvCache *cache) {
+    stub_query_count = 0;
+    assert(resolv_init(EV_DEFAULT, NULL, NULL, RESOLV_MODE_IPV4_ONLY,
+                cache) >= 0);
+}
+
+static void
+teardown() {
+    resolv_shutdown(EV_DEFAULT);
+
+    for (size_t i = 0; i < stub_query_count; i++)
+        assert(stub_queries[i].cancelled || stub_queries[i].completed);
+}
+
+static void
+test_coalesce_waiters() {
+    struct Client a = { 0 }, b = { 0 }, c = { 0 };
+
+    setup(NULL);
+
+    query(&a, "example.com", RESOLV_MODE_IPV4_ONLY);
+    query(&b, "example.com", RESOLV_MODE_IPV4_ONLY);
+    query(&c, "example.com", RESOLV_MODE_DEFAULT);
+    assert(stub_query_count == 1);
+    assert(strcmp(stub_queries[0].hostname, "example.com") == 0);
+
+    complete_a4(0, "192.0.2.1", 300);
+
+    assert(a.callbacks == 1 && a.freed == 1);
+    assert(b.callbacks == 1 && b.freed == 1);
+    assert(c.callbacks == 1 && c.freed == 1);
+    assert(strcmp(a.address, "192.0.2.1") == 0);
+    assert(strcmp(b.address, "192.0.2.1") == 0);
+    assert(strcmp(c.address, "192.0.2.1") == 0);
+
+    /* a completed request is no longer shared */
+    query(&a, "example.com", RESOLV_MODE_IPV4_ONLY);
+    assert(stub_query_count == 2);
+    complete_a4(1, NULL, 0);
+    assert(a.callbacks == 2 && a.freed == 2);
+    assert(a.address[0] == '\0');
+
+    teardown();
+}
+
+static void
+test_modes_not_coalesced() {
+    struct Client a = { 0 }, b = { 0 }, c = { 0 };
+
+    setup(NULL);
+
+    query(&a, "example.com", RESOLV_MODE_IPV4_ONLY);
+    query(&b, "example.com", RESOLV_MODE_IPV6_FIRST);
+    query(&c, "example.org", RESOLV_MODE_IPV4_ONLY);
+    assert(stub_query_count == 4);
+    assert(!stub_queries[1].is_a6 && stub_queries[2].is_a6);
+
+    /* both A and AAAA queries must complete before the callback */
+    complete_a4(1, "192.0.2.2", 300);
+    assert(b.callbacks == 0);
+    complete_a6(2, "2001:db8::2", 300);
+    assert(b.callbacks == 1 && b.freed == 1);
+    assert(strcmp(b.address, "[2001:db8::2]") == 0);
+    assert(a.callbacks == 0 && c.callbacks == 0);
+
+    complete_a4(3, "192.0.2.3", 300);
+    assert(c.callbacks == 1 && strcmp(c.address, "192.0.2.3") == 0);
+    complete_a4(0, "192.0.2.1", 300);
+    assert(a.callbacks == 1 && strcmp(a.address, "192.0.2.1") == 0);
+
+    teardown();
+}
+
+static void
+test_cancel_one_waiter() {
+    struct Client a = { 0 }, b = { 0 }, c = { 0 };
+
+    setup(NULL);
+
+    query(&a, "example.com", RESOLV_MODE_IPV4_ONLY);
+    query(&b, "example.com", RESOLV_MODE_IPV4_ONLY);
+    query(&c, "example.com", RESOLV_MODE_IPV4_ONLY);
+    assert(stub_query_count == 1);
+
+    resolv_cancel(b.handle);
+    assert(b.callbacks == 0 && b.freed == 1);
+    assert(active_queries() == 1);
+
+    resolv_cancel(a.handle);
+    assert(a.callbacks == 0 && a.freed == 1);
+    assert(active_queries() == 1);
+
+    complete_a4(0, "192.0.2.1", 300);
+    assert(a.callbacks == 0 && a.freed == 1);
+    assert(b.callbacks == 0 && b.freed == 1);
+    assert(c.callbacks == 1 && c.freed == 1);
+    assert(strcmp(c.address, "192.0.2.1") == 0);
+
+    teardown();
+}
+
+static void
+test_cancel_last_waiter() {
+    struct Client a = { 0 }, b = { 0 };
+
+    setup(NULL);
+
+    query(&a, "example.com", RESOLV_MODE_IPV4_FIRST);
+    query(&b, "example.com", RESOLV_MODE_IPV4_FIRST);
+    assert(stub_query_count == 2);
+
+    /* one of the two queries has already answered */
+    complete_a4(0, "192.0.2.1", 300);
+    assert(a.callbacks == 0 && b.callbacks == 0);
+
+    resolv_cancel(a.handle);
+    assert(active_queries() == 1);
+    resolv_cancel(b.handle);
+    assert(active_queries() == 0);
+    assert(!stub_queries[0].cancelled);
+    assert(stub_queries[1].cancelled);
+    assert(a.callbacks == 0 && a.freed == 1);
+    assert(b.callbacks == 0 && b.freed == 1);
+
+    /* the cancelled request is not reused */
+    query(&a, "example.com", RESOLV_MODE_IPV4_FIRST);
+    assert(stub_query_count == 4);
+    resolv_cancel(a.handle);
+    assert(stub_queries[2].cancelled && stub_queries[3].cancelled);
+
+    teardown();
+}
+
+static void
+test_requery_from_callback() {
+    struct Client a = { 0 }, b = { 0 }, c = { 0 };
+
+    setup(NULL);
+
+    a.requery = "example.com";
+    a.next = &c;
+    query(&a, "example.com", RESOLV_MODE_IPV4_ONLY);
+    query(&b, "example.com", RESOLV_MODE_IPV4_ONLY);
+    assert(stub_query_count == 1);
+
+    complete_a4(0, "192.0.2.1", 300);
+    assert(a.callbacks == 1 && b.callbacks == 1);
+
+    /* the new query started a request of its own */
+    assert(stub_query_count == 2);
+    assert(c.callbacks == 0 && c.handle != NULL);
+    assert(active_queries() == 1);
+
+    complete_a4(1, "192.0.2.2", 300);
+    assert(c.callbacks == 1 && c.freed == 1);
+    assert(strcmp(c.address, "192.0.2.2") == 0);
+    assert(a.callbacks == 1 && b.callbacks == 1);
+
+    teardown();
+}
+
+static void
+test_attach_to_refresh() {
+    struct ResolvCache *cache = new_resolv_cache(1, 0, 3600, 0, 3600);
+    struct Client a = { 0 }, b = { 0 }, c = { 0 }, d = { 0 };
+    assert(cache != NULL);
+
+    setup(cache);
+
+    /* an entry that expired ten seconds ago but is still within its stale TTL */
+    struct Address *response = new_address("192.0.2.1");
+    assert(response != NULL);
+    assert(resolv_cache_put(cache, "example.com", RESOLV_MODE_IPV4_ONLY,
+                &response, 1, 1, ev_now(EV_DEFAULT) - 11.0) == 1);
+    free(response);
+
+    /* the stale answer is delivered while a refresh is submitted */
+    query(&a, "example.com", RESOLV_MODE_IPV4_ONLY);
+    assert(stub_query_count == 1);
+    assert(a.callbacks == 0);
+    ev_run(EV_DEFAULT, EVRUN_NOWAIT);
+    assert(a.callbacks == 1 && a.freed == 1);
+    assert(strcmp(a.address, "192.0.2.1") == 0);
+
+    /* only one refresh is in flight */
+    query(&b, "example.com", RESOLV_MODE_IPV4_ONLY);
+    assert(stub_query_count == 1);
+    ev_run(EV_DEFAULT, EVRUN_NOWAIT);
+    assert(b.callbacks == 1 && strcmp(b.address, "192.0.2.1") == 0);
+
+    /* evict the stale entry so the next client misses the cache */
+    query(&c, "example.org", RESOLV_MODE_IPV4_ONLY);
+    assert(stub_query_count == 2);
+    complete_a4(1, "192.0.2.9", 300);
+    assert(c.callbacks == 1 && strcmp(c.address, "192.0.2.9") == 0);
+
+    /* and waits on the refresh already in flight */
+    query(&d, "example.com", RESOLV_MODE_IPV4_ONLY);
+    assert(stub_query_count == 2);
+    assert(d.callbacks == 0);
+
+    complete_a4(0, "192.0.2.2", 300);
+    assert(d.callbacks == 1 && d.freed == 1);
+    assert(strcmp(d.address, "192.0.2.2") == 0);
+
+    /* the refreshed answer was cached */
+    query(&a, "example.com", RESOLV_MODE_IPV4_ONLY);
+    assert(stub_query_count == 2);
+    ev_run(EV_DEFAULT, EVRUN_NOWAIT);
+    assert(a.callbacks == 2 && strcmp(a.address, "192.0.2.2") == 0);
+
+    teardown();
+}
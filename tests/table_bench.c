@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "table.h"
+#include "backend.h"
+#include "logger.h"
+
+/*
+ * Measure the cost of table lookups against a large table of patterns which
+ * can not be indexed, so every lookup is evaluated by PCRE, with and without
+ * JIT compilation.
+ *
+ * Usage: table_bench [entries] [lookups]
+ */
+
+static struct Table *new_bench_table(size_t, int);
+static double bench_lookups(const struct Table *, size_t, size_t);
+static double elapsed(const struct timespec *, const struct timespec *);
+
+
+int main(int argc, char **argv) {
+    size_t entries = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+    size_t lookups = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000;
+
+    struct Logger *logger = new_file_logger("/dev/stderr");
+    assert(logger != NULL);
+    set_logger_priority(logger, LOG_NOTICE);
+    set_default_logger(logger);
+
+    for (int jit = 0; jit <= 1; jit++) {
+        struct Table *table = new_bench_table(entries, jit);
+
+        double ns = bench_lookups(table, entries, lookups);
+        printf("pcre_jit %-3s %zu entries: %.0f ns/lookup\n",
+                jit ? "on" : "off", entries, ns);
+
+        table_ref_put(table);
+    }
+
+    free_backend_jit_stack();
+
+    return 0;
+}
+
+static struct Table *
+new_bench_table(size_t entries, int jit) {
+    struct Table *table = new_table();
+    assert(table != NULL);
+    table_ref_get(table);
+    table->pcre_jit = jit;
+
+    for (size_t i = 0; i < entries; i++) {
+        char pattern[64];
+        struct Backend *backend = new_backend();
+        assert(backend != NULL);
+
+        snprintf(pattern, sizeof(pattern),
+                "^(www\\.)?host%zu\\.example\\.(com|net)$", i);
+        assert(accept_backend_arg(backend, pattern) == 1);
+        assert(accept_backend_arg(backend, "192.0.2.10") == 1);
+        add_backend(&table->backends, backend);
+    }
+
+    init_table(table);
+
+    return table;
+}
+
+/*
+ * Returns the mean time per lookup in nanoseconds, names are spread evenly
+ * across the table so on average half the patterns are evaluated
+ */
+static double
+bench_lookups(const struct Table *table, size_t entries, size_t lookups) {
+    struct timespec start, end;
+    char name[64];
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < lookups; i++) {
+        int len = snprintf(name, sizeof(name), "www.host%zu.example.net",
+                (i * 7919) % entries);
+
+        struct LookupResult result =
+            table_lookup_server_address(table, name, (size_t)len, NULL, 0);
+        assert(result.address != NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return elapsed(&start, &end) / lookups;
+}
+
+static double
+elapsed(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 +
+        (end->tv_nsec - start->tv_nsec);
+}
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include "table.h"
 #include "backend.h"
+#include "address.h"
 
 
 static void test_empty_table();
@@ -12,6 +13,11 @@ static void append_entry(struct Table *, const char *, const char *);
 static void add_new_table(struct Table_head *, const char *, const char **);
 static void test_add_table();
 static void test_tables_reload();
+static void test_indexed_lookup();
+static void test_combined_lookup();
+static void test_alpn_lookup();
+static void test_uppercase_patterns();
+static void assert_lookup(const struct Table *, const char *, const char *);
 static int count_tables(const struct Table_head *);
 
 
@@ -20,6 +26,10 @@ int main() {
     test_single_entry_table();
     test_add_table();
     test_tables_reload();
+    test_indexed_lookup();
+    test_combined_lookup();
+    test_alpn_lookup();
+    test_uppercase_patterns();
 }
 
 static void
@@ -37,7 +47,7 @@ test_empty_table() {
 
     const char *server_query = "example.com";
     struct LookupResult result = table_lookup_server_address(table,
-            server_query, strlen(server_query));
+            server_query, strlen(server_query), NULL, 0);
     assert(result.address == NULL);
 
     table_ref_put(table);
@@ -74,7 +84,7 @@ test_single_entry_table() {
 
     const char *server_query = "example.com";
     struct LookupResult result = table_lookup_server_address(table,
-            server_query, strlen(server_query));
+            server_query, strlen(server_query), NULL, 0);
     assert(result.address != NULL);
 
     table_ref_put(table);
@@ -164,6 +174,7 @@ test_tables_reload() {
     add_new_table(&new, "foo", (const char *[]){
             "^.*$", "*",
             NULL});
+    table_lookup(&new, "foo")->pcre_jit = 0;
 
     struct Table *bar = table_lookup(&existing, "bar");
     assert(bar != NULL);
@@ -183,7 +194,223 @@ test_tables_reload() {
     table = table_lookup(&existing, "foo");
     assert(table != NULL);
     assert(strcmp("foo", table->name) == 0);
+    /* the JIT setting is replaced along with the backends */
+    assert(table->pcre_jit == 0);
 
     free_tables(&existing);
     table_ref_put(bar);
 }
+
+static void
+assert_lookup(const struct Table *table, const char *name,
+        const char *expected) {
+    char buffer[ADDRESS_BUFFER_SIZE];
+    struct LookupResult result = table_lookup_server_address(table,
+            name, strlen(name), NULL, 0);
+
+    if (expected == NULL) {
+        assert(result.address == NULL);
+        return;
+    }
+
+    assert(result.address != NULL);
+    assert(strcmp(expected,
+            display_address(result.address, buffer, sizeof(buffer))) == 0);
+}
+
+static void
+test_indexed_lookup() {
+    struct Table_head tables = SLIST_HEAD_INITIALIZER();
+
+    add_new_table(&tables, "indexed", (const char *[]){
+            "^example\\.com$", "192.0.2.10",
+            "^www\\.example\\.(com|net)$", "192.0.2.11",
+            "^www\\.example\\.com$", "192.0.2.12",
+            "^.*\\.example\\.com$", "192.0.2.13",
+            "\\.example\\.net$", "192.0.2.14",
+            "^a\\.b\\.example\\.net$", "192.0.2.15",
+            "^foo[0-9]\\.example\\.org$", "192.0.2.16",
+            "^.*$", "192.0.2.17",
+            NULL});
+
+    struct Table *table = table_lookup(&tables, "indexed");
+    assert(table != NULL);
+    init_table(table);
+    assert(table->backend_index != NULL);
+
+    assert_lookup(table, "example.com", "192.0.2.10");
+    /* Regular expression listed before literal match takes precedence */
+    assert_lookup(table, "www.example.com", "192.0.2.11");
+    assert_lookup(table, "www.example.net", "192.0.2.11");
+    assert_lookup(table, "mail.example.com", "192.0.2.13");
+    assert_lookup(table, "a.b.example.com", "192.0.2.13");
+    /* Suffix listed before a more specific literal takes precedence */
+    assert_lookup(table, "a.b.example.net", "192.0.2.14");
+    assert_lookup(table, "example.net", "192.0.2.17");
+    assert_lookup(table, "xexample.com", "192.0.2.17");
+    assert_lookup(table, "foo1.example.org", "192.0.2.16");
+    assert_lookup(table, "", "192.0.2.17");
+    /* PCRE $ matches before a trailing newline */
+    assert_lookup(table, "example.com\n", "192.0.2.10");
+
+    free_tables(&tables);
+
+    add_new_table(&tables, "literal", (const char *[]){
+            "^example\\.com$", "192.0.2.20",
+            "^\\.example\\.com$", "192.0.2.21",
+            "^example\\.com$", "192.0.2.22",
+            "^example\\.co$", "192.0.2.23",
+            NULL});
+
+    table = table_lookup(&tables, "literal");
+    assert(table != NULL);
+    init_table(table);
+
+    assert_lookup(table, "example.com", "192.0.2.20");
+    assert_lookup(table, ".example.com", "192.0.2.21");
+    assert_lookup(table, "www.example.com", NULL);
+    assert_lookup(table, "example.co", "192.0.2.23");
+    assert_lookup(table, "example.comm", NULL);
+    assert_lookup(table, "com", NULL);
+
+    free_tables(&tables);
+}
+
+static void
+test_combined_lookup() {
+    struct Table_head tables = SLIST_HEAD_INITIALIZER();
+
+    for (int jit = 0; jit <= 1; jit++) {
+        add_new_table(&tables, "combined", (const char *[]){
+                "^mail\\.", "192.0.2.30",
+                "example\\.(com|net)$", "192.0.2.31",
+                "^(www|ftp)\\.example\\.org$", "192.0.2.32",
+                "^(a+)\\.\\1$", "192.0.2.33",
+                "^[^.]+\\.test$|^test$", "192.0.2.34",
+                "(?<=\\.)local$", "192.0.2.35",
+                NULL});
+
+        struct Table *table = table_lookup(&tables, "combined");
+        assert(table != NULL);
+        table->pcre_jit = jit;
+        init_table(table);
+
+        assert_lookup(table, "mail.example.com", "192.0.2.30");
+        assert_lookup(table, "www.example.com", "192.0.2.31");
+        assert_lookup(table, "www.example.org", "192.0.2.32");
+        assert_lookup(table, "mail.example.org", "192.0.2.30");
+        /* pattern with a back reference is evaluated separately */
+        assert_lookup(table, "aa.aa", "192.0.2.33");
+        assert_lookup(table, "aa.a", NULL);
+        assert_lookup(table, "foo.test", "192.0.2.34");
+        assert_lookup(table, "test", "192.0.2.34");
+        assert_lookup(table, "foo.bar.test", NULL);
+        assert_lookup(table, "host.local", "192.0.2.35");
+        assert_lookup(table, "local", NULL);
+
+        free_tables(&tables);
+    }
+}
+
+/*
+ * Hostnames are looked up in lowercase, patterns written with uppercase
+ * letters still match them whether indexed, combined or evaluated alone
+ */
+static void
+test_uppercase_patterns() {
+    struct Table_head tables = SLIST_HEAD_INITIALIZER();
+
+    for (int jit = 0; jit <= 1; jit++) {
+        add_new_table(&tables, "uppercase", (const char *[]){
+                "^www\\.Example\\.com$", "192.0.2.50",
+                "^.*\\.Example\\.NET$", "192.0.2.51",
+                "^Mail\\.(example|test)\\.org$", "192.0.2.52",
+                "^FTP\\.(example|test)\\.org$", "192.0.2.53",
+                "^(A+)\\.\\1$", "192.0.2.54",
+                NULL});
+
+        struct Table *table = table_lookup(&tables, "uppercase");
+        assert(table != NULL);
+        table->pcre_jit = jit;
+        init_table(table);
+
+        assert_lookup(table, "www.example.com", "192.0.2.50");
+        assert_lookup(table, "host.example.net", "192.0.2.51");
+        assert_lookup(table, "mail.test.org", "192.0.2.52");
+        assert_lookup(table, "ftp.example.org", "192.0.2.53");
+        assert_lookup(table, "aa.aa", "192.0.2.54");
+        assert_lookup(table, "example.com", NULL);
+
+        free_tables(&tables);
+    }
+}
+
+static void
+assert_alpn_lookup(const struct Table *table, const char *name,
+        const char *alpn, size_t alpn_len, const char *expected) {
+    char buffer[ADDRESS_BUFFER_SIZE];
+    struct LookupResult result = table_lookup_server_address(table,
+            name, strlen(name), alpn, alpn_len);
+
+    assert(result.address != NULL);
+    assert(strcmp(expected,
+            display_address(result.address, buffer, sizeof(buffer))) == 0);
+
+    /* the unindexed lookup agrees */
+    struct Backend *backend =
+        lookup_backend(&table->backends, name, strlen(name), alpn, alpn_len);
+    assert(backend != NULL);
+    assert(backend->address == result.address);
+}
+
+static void
+test_alpn_lookup() {
+    static const char h2_and_http11[] = "\x02h2\x08http/1.1";
+    static const char http11[] = "\x08http/1.1";
+    static const char h2[] = "\x02h2";
+    static const char *entries[][3] = {
+        { "^example\\.com$", "192.0.2.40", "alpn=h2" },
+        { "^example\\.com$", "192.0.2.41", NULL },
+        { "^.*\\.example\\.net$", "192.0.2.42", "alpn=h2c,http/1.1" },
+        { "^.*$", "192.0.2.43", NULL },
+    };
+    struct Table *table = new_table();
+    assert(table != NULL);
+    table_ref_get(table);
+
+    for (size_t i = 0; i < sizeof(entries) / sizeof(entries[0]); i++) {
+        struct Backend *backend = new_backend();
+        assert(backend != NULL);
+
+        for (size_t j = 0; j < 3 && entries[i][j] != NULL; j++)
+            assert(accept_backend_arg(backend, entries[i][j]) == 1);
+
+        add_backend(&table->backends, backend);
+    }
+
+    /* empty protocol name */
+    struct Backend_head rejected = STAILQ_HEAD_INITIALIZER(rejected);
+    struct Backend *backend = new_backend();
+    assert(backend != NULL);
+    assert(accept_backend_arg(backend, "^example\\.org$") == 1);
+    assert(accept_backend_arg(backend, "192.0.2.44") == 1);
+    assert(accept_backend_arg(backend, "alpn=h2,,http/1.1") == -1);
+    add_backend(&rejected, backend);
+    remove_backend(&rejected, backend);
+
+    init_table(table);
+    assert(table->alpn_backends == 2);
+
+    assert_alpn_lookup(table, "example.com",
+            h2_and_http11, sizeof(h2_and_http11) - 1, "192.0.2.40");
+    assert_alpn_lookup(table, "example.com",
+            http11, sizeof(http11) - 1, "192.0.2.41");
+    assert_alpn_lookup(table, "example.com", NULL, 0, "192.0.2.41");
+    assert_alpn_lookup(table, "www.example.net",
+            http11, sizeof(http11) - 1, "192.0.2.42");
+    assert_alpn_lookup(table, "www.example.net",
+            h2, sizeof(h2) - 1, "192.0.2.43");
+    assert_alpn_lookup(table, "www.example.net", NULL, 0, "192.0.2.43");
+
+    table_ref_put(table);
+}
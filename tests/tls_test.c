@@ -405,6 +405,46 @@ const unsigned char bad_data_4[] = {
             0x00, 0x01, // Length
             0x01 // Mode: Peer allows to send requests
 };
+const unsigned char alpn_data[] = {
+    // TLS record
+    0x16, // Content Type: Handshake
+    0x03, 0x01, // Version: TLS 1.0
+    0x00, 0x55, // Length
+        // Handshake
+        0x01, // Handshake Type: Client Hello
+        0x00, 0x00, 0x51, // Length
+        0x03, 0x03, // Version: TLS 1.2
+        // Random
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x00, // Session ID Length
+        0x00, 0x04, // Cipher Suites Length
+            0x00, 0x01, // NULL-MD5
+            0x00, 0xff, // RENEGOTIATION INFO SCSV
+        0x01, // Compression Methods
+            0x00, // NULL
+        0x00, 0x24, // Extensions Length
+            // Extension
+            0x00, 0x10, // Extension Type: ALPN
+            0x00, 0x0e, // Length
+            0x00, 0x0c, // Protocol Name List Length
+                0x02, // Length
+                // "h2"
+                0x68, 0x32,
+                0x08, // Length
+                // "http/1.1"
+                0x68, 0x74, 0x74, 0x70, 0x2f, 0x31, 0x2e, 0x31,
+            // Extension
+            0x00, 0x00, // Extension Type: Server Name
+            0x00, 0x0e, // Length
+            0x00, 0x0c, // Server Name Indication Length
+                0x00, // Server Name Type: host_name
+                0x00, 0x09, // Length
+                // "localhost"
+                0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x68, 0x6f, 0x73, 0x74
+};
 static struct test_packet good[] = {
     { (char *)good_data_1, sizeof(good_data_1) },
     { (char *)good_data_2, sizeof(good_data_2) },
@@ -421,6 +461,91 @@ static struct test_packet bad[] = {
     { (char *)bad_data_3, sizeof(bad_data_3) }
 };
 
+/*
+ * Split the client hello in a single record packet into records holding at
+ * most fragment_len bytes of the handshake message each
+ */
+static size_t
+fragment_client_hello(const struct test_packet *packet, size_t fragment_len,
+        char *fragmented) {
+    const char *message = packet->packet + 5;
+    size_t message_len = packet->len - 5;
+    size_t len = 0;
+
+    for (size_t pos = 0; pos < message_len; pos += fragment_len) {
+        size_t record_len = message_len - pos < fragment_len ?
+            message_len - pos : fragment_len;
+
+        memcpy(fragmented + len, packet->packet, 3); /* type and version */
+        fragmented[len + 3] = (char)(record_len >> 8);
+        fragmented[len + 4] = (char)(record_len & 0xff);
+        memcpy(fragmented + len + 5, message + pos, record_len);
+        len += 5 + record_len;
+    }
+
+    return len;
+}
+
+static void test_fragmented_client_hello() {
+    static const size_t fragment_lens[] = { 1, 2, 100, 256 };
+    char fragmented[4096];
+    char name[HOSTNAME_MAX_LEN + 1];
+    char *hostname;
+    size_t len;
+    int result;
+
+    for (size_t i = 0; i < sizeof(fragment_lens) / sizeof(fragment_lens[0]); i++) {
+        struct ParseState state = { .offset = 0, .need = 0 };
+        size_t fragmented_len = fragment_client_hello(&good[0],
+                fragment_lens[i], fragmented);
+        assert(fragmented_len < sizeof(fragmented));
+
+        hostname = NULL;
+        result = tls_protocol->parse_packet(fragmented, fragmented_len, &hostname);
+        assert(result == 9);
+        assert(0 == strcmp("localhost", hostname));
+        free(hostname);
+
+        /* incomplete until the last record is received */
+        for (len = 0; len < fragmented_len; len++) {
+            result = tls_protocol->resume_parse(fragmented, len, name, &state);
+            assert(result == -1);
+        }
+        result = tls_protocol->resume_parse(fragmented, len, name, &state);
+        assert(result == 9);
+        assert(0 == strcmp("localhost", name));
+    }
+
+    /* records of other types may not be interleaved */
+    len = fragment_client_hello(&good[0], 100, fragmented);
+    fragmented[105] = 0x17; /* application data */
+    hostname = NULL;
+    result = tls_protocol->parse_packet(fragmented, len, &hostname);
+    assert(result < -4);
+    assert(hostname == NULL);
+}
+
+static void test_alpn() {
+    struct ParseState state = { .offset = 0, .need = 0 };
+    char name[HOSTNAME_MAX_LEN + 1];
+    int result;
+
+    /* protocol names are recorded in wire format */
+    result = tls_protocol->resume_parse((const char *)alpn_data,
+            sizeof(alpn_data), name, &state);
+    assert(result == 9);
+    assert(0 == strcmp("localhost", name));
+    assert(state.alpn_len == 12);
+    assert(0 == memcmp("\x02h2\x08http/1.1", state.alpn, state.alpn_len));
+
+    /* no ALPN extension */
+    state = (struct ParseState){ .offset = 0, .need = 0 };
+    result = tls_protocol->resume_parse(good[0].packet, good[0].len, name,
+            &state);
+    assert(result == 9);
+    assert(state.alpn_len == 0);
+}
+
 int main() {
     unsigned int i;
     int result;
@@ -456,6 +581,27 @@ int main() {
         free(hostname);
     }
 
+    /* client hello received one byte at a time */
+    for (i = 0; i < sizeof(good) / sizeof(struct test_packet); i++) {
+        struct ParseState state = { .offset = 0, .need = 0 };
+        char name[HOSTNAME_MAX_LEN + 1];
+        size_t len;
+
+        for (len = 0; len < good[i].len; len++) {
+            result = tls_protocol->resume_parse(good[i].packet, len, name, &state);
+            assert(result == -1);
+        }
+        assert(state.need == good[i].len);
+
+        result = tls_protocol->resume_parse(good[i].packet, len, name, &state);
+        assert(result == 9);
+        assert(0 == strcmp("localhost", name));
+    }
+
+    test_fragmented_client_hello();
+
+    test_alpn();
+
     return 0;
 }
 